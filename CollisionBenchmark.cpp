@@ -0,0 +1,131 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+// Micro-benchmark of the brute force collision query: the original array of glm::vec3 loop against the
+// structure of arrays SIMD kernel of VertexObstacles. Doesn't need Vulkan: the vertices are random points
+// spread over the city footprint, plus rings of points at exactly the query radius to check the boundary cases.
+// usage: collision-benchmark [vertices] [queries]
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include "VertexObstacles.hpp"
+
+/**
+ * the loop VertexObstacles used to run on std::vector<glm::vec3>
+ */
+float arrayOfStructuresQuery(const std::vector<glm::vec3>& vertices, glm::vec2 center, float radius) {
+    float highest = HeightObstacles::NO_OBSTACLE_HEIGHT;
+    for (auto p : vertices) {
+        if (glm::length(glm::vec2(p.x, p.z) - center) < radius && p.y > highest) {
+            highest = p.y;
+        }
+    }
+    return highest;
+}
+
+/**
+ * ring of points around center at the radius, each moved by a few ulps in and out along z: the squared distance of
+ * some of them is below radius * radius while their distance isn't below radius, or the opposite
+ */
+std::vector<glm::vec3> boundaryRing(glm::vec2 center, float radius) {
+    const int directions = 256;
+    const int ulps = 3;
+    std::vector<glm::vec3> points;
+    for (int d = 0; d < directions; ++d) {
+        float angle = 6.2831853f * static_cast<float>(d) / directions;
+        float dx = radius * std::cos(angle);
+        float dz = std::sqrt(std::max(0.0f, radius * radius - dx * dx)) * (angle < 3.1415927f ? 1.0f : -1.0f);
+        for (int u = 0; u < ulps; ++u) dz = std::nextafter(dz, 0.0f);
+        for (int u = - ulps; u <= ulps; ++u) {
+            points.emplace_back(center.x + dx, static_cast<float>(points.size()), center.y + dz);
+            dz = std::nextafter(dz, dz < 0 ? - INFINITY : INFINITY);
+        }
+    }
+    return points;
+}
+
+template<class Query>
+double nanosecondsPerQuery(const std::vector<glm::vec2>& queries, Query query, float& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    float sum = 0;
+    for (auto q : queries) sum += query(q);
+    auto end = std::chrono::steady_clock::now();
+    checksum = sum;
+    return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+}
+
+int main(int argc, char* argv[]) {
+    size_t vertexCount = argc > 1 ? std::stoul(argv[1]) : 100000;
+    size_t queryCount = argc > 2 ? std::stoul(argv[2]) : 10000;
+    const float radius = 1.0f;
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> footprint(-60, 60);
+    std::uniform_real_distribution<float> height(0, 30);
+    std::vector<glm::vec3> vertices(vertexCount);
+    for (auto& v : vertices) v = {footprint(generator), height(generator), footprint(generator)};
+    std::vector<glm::vec2> queries(queryCount);
+    for (auto& q : queries) q = {footprint(generator), footprint(generator)};
+
+    VertexObstacles obstacles(vertices);
+
+    // results have to match before timings mean anything
+    size_t mismatches = 0;
+    for (auto q : queries) {
+        float simd = obstacles.highestPointWithin(q, radius);
+        if (simd != obstacles.scalarHighestPointWithin(q, radius)) mismatches++;
+        if (simd != arrayOfStructuresQuery(vertices, q, radius)) mismatches++;
+    }
+    // also on the boundary of the cylinder, where comparing the squared distance with radius * radius can disagree
+    // with glm::length: around the origin, where the differences are exact, and around some of the queries
+    size_t boundaryCases = 0;
+    std::vector<glm::vec2> centers = {glm::vec2(0)};
+    centers.insert(centers.end(), queries.begin(), queries.begin() + std::min<size_t>(queries.size(), 100));
+    for (float boundaryRadius : {radius, 0.7f, 1.5f, 2.3f, 7.9f}) {
+        for (auto c : centers) {
+            // one point at a time: with all of them, a wrong one would be hidden by a higher one inside
+            for (auto p : boundaryRing(c, boundaryRadius)) {
+                glm::vec2 d = glm::vec2(p.x, p.z) - c;
+                if ((d.x * d.x + d.y * d.y < boundaryRadius * boundaryRadius) != (glm::length(d) < boundaryRadius)) {
+                    boundaryCases++;
+                }
+                VertexObstacles boundary({p});
+                float simd = boundary.highestPointWithin(c, boundaryRadius);
+                if (simd != boundary.scalarHighestPointWithin(c, boundaryRadius)) mismatches++;
+                if (simd != arrayOfStructuresQuery({p}, c, boundaryRadius)) mismatches++;
+            }
+        }
+    }
+
+    float aosChecksum, scalarChecksum, simdChecksum;
+    double aos = nanosecondsPerQuery(queries, [&](glm::vec2 q) {
+        return arrayOfStructuresQuery(vertices, q, radius);
+    }, aosChecksum);
+    double scalar = nanosecondsPerQuery(queries, [&](glm::vec2 q) {
+        return obstacles.scalarHighestPointWithin(q, radius);
+    }, scalarChecksum);
+    double simd = nanosecondsPerQuery(queries, [&](glm::vec2 q) {
+        return obstacles.highestPointWithin(q, radius);
+    }, simdChecksum);
+
+#if defined(__AVX2__)
+    const char* kernel = "AVX2";
+#elif defined(__SSE2__) || defined(_M_X64)
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+    std::cout << vertexCount << " vertices, " << queryCount << " queries, " << kernel << " kernel\n";
+    std::cout << "AoS glm::length loop: " << aos << " ns/query (checksum " << aosChecksum << ")\n";
+    std::cout << "SoA scalar loop:      " << scalar << " ns/query (checksum " << scalarChecksum << ")\n";
+    std::cout << "SoA SIMD kernel:      " << simd << " ns/query (checksum " << simdChecksum << ")\n";
+    std::cout << "speedup over AoS: " << aos / simd << "x\n";
+    std::cout << "boundary points where radius * radius alone would disagree with glm::length: " << boundaryCases << "\n";
+    std::cout << "mismatches: " << mismatches << "\n";
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -15,21 +15,28 @@
 //        mat3  : alignas(16)
 //        mat4  : alignas(16)
 
+// metallic and opaque objects only keep their material in the uniform block: the transforms are push constants
 struct MetallicUniformBlock {
     alignas(4) float amb;
     alignas(4) float gamma;
     alignas(16) glm::vec3 sColor;
-    alignas(16) glm::mat4 mvpMat;
-    alignas(16) glm::mat4 mMat;
-    alignas(16) glm::mat4 nMat;
 };
 
 struct OpaqueUniformBlock {
     alignas(4) float amb;
     alignas(4) float sigma;
+};
+
+// push constants of the metallic and opaque pipelines: 128 bytes, the size every device supports
+// (the normal matrix is computed by the vertex shader from mMat)
+struct ModelPushConstants {
     alignas(16) glm::mat4 mvpMat;
     alignas(16) glm::mat4 mMat;
-    alignas(16) glm::mat4 nMat;
+};
+
+// transforms of the city blocks, drawn by a single indirect draw: the firstInstance of each block is its index here
+struct CityUniformBlock {
+    ModelPushConstants blocks[12];
 };
 
 struct EmitUniformBlock {
@@ -38,15 +45,15 @@ struct EmitUniformBlock {
     alignas(16) glm::mat4 mvpMat;
     alignas(16) glm::mat4 mMat;
     alignas(16) glm::mat4 nMat;
-    alignas(16) glm::vec3 offset;
-    alignas(4) float dim; // one of the 2 dimensions - other obtained by repeating the instances
 };
 
-struct OverlayUniformBlock {
-    alignas(4) float visible; // applies to all instances
-    alignas(16) glm::mat4 mvpMat;
-    alignas(8) glm::vec2 offset;
-    alignas(4) float instancesToDraw; // applies only if visible == 1
+// an image of the HUD, drawn as instances of the overlay quad: the i-th is moved by offset * i
+struct OverlayElement {
+    bool visible = false; // applies to all instances
+    glm::vec4 rect{-1, -1, 1, 1}; // of the first instance, corners in normalized device coordinates (x0, y0, x1, y1)
+    glm::vec2 offset{0};
+    int instancesToDraw = 1; // applies only if visible
+    int atlasImage = 0;
 };
 
 struct AnimationUniformBlock {
@@ -71,6 +78,17 @@ struct VertexClassic {
     glm::vec2 UV;
 };
 
+// per instance attributes of the instanced pipelines: where the instance is, in the coordinates of the model
+struct InstanceTransform {
+    glm::mat4 mMat;
+};
+
+// per instance attributes of the overlay pipeline: where the quad is on screen and which image of the atlas it shows
+struct OverlayInstance {
+    glm::vec4 rect;
+    glm::vec4 region; // uv offset in xy, uv size in zw
+};
+
 struct VertexOverlay {
     glm::vec2 pos;
     glm::vec2 UV;
@@ -0,0 +1,263 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_DRONEFLEET_HPP
+#define DRONE_DELIVERY_DRONEFLEET_HPP
+
+#include <vector>
+#include <thread>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "Plane.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * Many drones flying with the same physics as Plane, stored as a structure of arrays: each state variable of all the
+ * drones is a contiguous array, so a step walks memory linearly and the fleet can be split across threads in chunks.
+ * Instead of a UserInputs pointer each drone has its control values (already mapped as ControlsMapping does), and
+ * instead of the Damper objects it has the last damped value of each control: the damping factor only depends on
+ * deltaT, so it is computed once per step for the whole fleet.
+ * The threads of a parallel step are kept in a pool across steps, since starting them costs about as much as stepping
+ * a few thousand drones.
+ */
+class DroneFleet {
+public:
+    constexpr static const size_t MIN_DRONES_PER_THREAD = 256; // smaller chunks cost more to hand out than to step
+
+private:
+    // state in world coordinates
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<glm::quat> rotation;
+    // state at the previous step, interpolated for rendering
+    std::vector<float> previousX, previousY, previousZ;
+    std::vector<glm::quat> previousRotation;
+    // controls in [-1, 1] and their damped values
+    std::vector<float> roll, yaw, pitch, throttle;
+    std::vector<float> dampedRoll, dampedYaw, dampedPitch, dampedThrottle;
+    // collision of the last step, and whether each of the last PREV_COLLISIONS_SIZE steps had a MESH collision
+    std::vector<uint8_t> collision;
+    std::vector<uint16_t> meshHistory;
+    std::vector<uint8_t> hasHistory;
+    std::vector<glm::vec3> initialPosition;
+
+    const Wing& wing;
+    const Obstacles& obstacles;
+    std::unique_ptr<ThreadPool> workers; // the caller steps a chunk too: one thread less than the chunks
+
+    static float dampedValue(float previous, float next, float factor) {
+        // Damper<float> with constraints at -1 and 1
+        return glm::clamp(previous * factor + next * (1 - factor), -1.0f, 1.0f);
+    }
+
+    void stepDrone(size_t i, float deltaT, float rotationFactor, float throttleFactor) {
+        glm::vec3 position{px[i], py[i], pz[i]};
+        glm::vec3 speed{vx[i], vy[i], vz[i]};
+        glm::quat q = rotation[i];
+        previousX[i] = px[i];
+        previousY[i] = py[i];
+        previousZ[i] = pz[i];
+        previousRotation[i] = q;
+
+        // computed exactly as Plane does: the flight is sensitive enough that transposing instead of inverting (the same
+        // matrix, up to rounding) drifts visibly away from Plane in a few seconds
+        glm::mat3 uAxes = glm::toMat4(q);
+        glm::mat3 toPlane = glm::inverse(uAxes);
+        float wingLift = wing.computeLift((toPlane * speed).z);
+
+        dampedRoll[i] = dampedValue(dampedRoll[i], roll[i], rotationFactor);
+        dampedYaw[i] = dampedValue(dampedYaw[i], yaw[i], rotationFactor);
+        dampedPitch[i] = dampedValue(dampedPitch[i], pitch[i], rotationFactor);
+        dampedThrottle[i] = dampedValue(dampedThrottle[i], throttle[i], throttleFactor);
+        q = glm::rotate(q, Plane::CONTROL_SURFACES_ROT_ACCELERATION.x * wingLift * dampedRoll[i] * deltaT, glm::vec3(1, 0, 0));
+        q = glm::rotate(q, Plane::CONTROL_SURFACES_ROT_ACCELERATION.y * wingLift * dampedYaw[i] * deltaT, glm::vec3(0, 1, 0));
+        q = glm::rotate(q, Plane::CONTROL_SURFACES_ROT_ACCELERATION.z * wingLift * dampedPitch[i] * deltaT, glm::vec3(0, 0, 1));
+
+        speed += deltaT * Plane::EXTERNAL_ACCELERATIONS;
+
+        glm::vec3 planeSpeed = toPlane * speed;
+        planeSpeed += deltaT * (
+                glm::vec3(0.0f, 0.0f, dampedThrottle[i] * Plane::ENGINE_ACCELERATION)
+                + glm::vec3(0.0, std::cos(Plane::WING_LIFT_ANGLE) * wingLift,
+                            - Plane::WING_INEFFICIENCY * std::sin(Plane::WING_LIFT_ANGLE) * wingLift)
+        );
+        planeSpeed -= deltaT * Plane::FRICTION * planeSpeed;
+        if (glm::length(planeSpeed) > Plane::MAX_SPEED) planeSpeed = Plane::MAX_SPEED * glm::normalize(planeSpeed);
+        speed = uAxes * planeSpeed;
+
+        glm::vec3 previous = position;
+        position += speed * deltaT;
+
+        // same detection and reaction as Plane::detectCollisions and Plane::reactToCollision
+        Collision detected = NONE;
+        float impact = obstacles.timeOfImpact(previous, position, Plane::COLLISION_DISTANCE);
+        if (impact != Obstacles::NO_IMPACT) {
+            glm::vec3 movement = position - previous;
+            float length = glm::length(movement);
+            float backOff = length > 0 ? Plane::COLLISION_SKIN / length : 0;
+            position = previous + movement * std::max(0.0f, impact - backOff);
+            detected = MESH;
+        } else if (position.y < 0) {
+            detected = GROUND;
+        }
+
+        switch (detected) {
+            case NONE: break;
+            case GROUND: {
+                position.y = 0;
+                speed.y = 0;
+                if (hasHistory[i] && collision[i] == NONE) {
+                    float tempYaw = glm::eulerAngles(q).y;
+                    float levelYaw = speed.z >= 0 ? tempYaw : static_cast<float>(M_PI) - tempYaw;
+                    q = glm::angleAxis(levelYaw, glm::vec3{0, 1, 0});
+                }
+                break;
+            }
+            case MESH: {
+                speed *= Plane::MESH_COLLISION_BOUNCE;
+                int previousMeshCollisions = 0;
+                for (uint16_t bits = meshHistory[i]; bits; bits &= bits - 1) previousMeshCollisions++;
+                if (previousMeshCollisions > Plane::SUCCESSIVE_MESH_COLLISIONS) {
+                    position = {0, 0, 0};
+                    previousX[i] = previousY[i] = previousZ[i] = 0;
+                    speed = {0, 0, 0};
+                }
+                break;
+            }
+        }
+        const uint16_t historyMask = (1u << Plane::PREV_COLLISIONS_SIZE) - 1;
+        meshHistory[i] = ((meshHistory[i] << 1) | (detected == MESH ? 1 : 0)) & historyMask;
+        collision[i] = detected;
+        hasHistory[i] = 1;
+
+        px[i] = position.x;
+        py[i] = position.y;
+        pz[i] = position.z;
+        vx[i] = speed.x;
+        vy[i] = speed.y;
+        vz[i] = speed.z;
+        rotation[i] = q;
+    }
+
+    void stepRange(size_t begin, size_t end, float deltaT) {
+        float rotationFactor = std::exp(- Plane::ROT_DAMPING * deltaT);
+        float throttleFactor = std::exp(- Plane::THROTTLE_DAMPING * deltaT);
+        for (size_t i = begin; i < end; ++i) {
+            stepDrone(i, deltaT, rotationFactor, throttleFactor);
+        }
+    }
+
+public:
+    DroneFleet(const Wing& wing, const Obstacles& obstacles) :
+            wing(wing),
+            obstacles(obstacles) {}
+
+    /**
+     * adds a drone at rest
+     * @return index of the drone
+     */
+    size_t add(glm::vec3 position, glm::quat initialRotation = glm::identity<glm::quat>()) {
+        px.push_back(position.x);
+        py.push_back(position.y);
+        pz.push_back(position.z);
+        vx.push_back(Plane::INITIAL_SPEED.x);
+        vy.push_back(Plane::INITIAL_SPEED.y);
+        vz.push_back(Plane::INITIAL_SPEED.z);
+        rotation.push_back(initialRotation);
+        previousX.push_back(position.x);
+        previousY.push_back(position.y);
+        previousZ.push_back(position.z);
+        previousRotation.push_back(initialRotation);
+        for (auto array : {&roll, &yaw, &pitch, &throttle, &dampedRoll, &dampedYaw, &dampedPitch, &dampedThrottle}) {
+            array->push_back(0);
+        }
+        collision.push_back(NONE);
+        meshHistory.push_back(0);
+        hasHistory.push_back(0);
+        initialPosition.push_back(position);
+        return size() - 1;
+    }
+
+    size_t size() const {
+        return px.size();
+    }
+
+    void setControls(size_t index, const ControlsMapping& controls) {
+        roll[index] = controls.roll;
+        yaw[index] = controls.yaw;
+        pitch[index] = controls.pitch;
+        throttle[index] = controls.speed;
+    }
+
+    /**
+     * advances all the drones by a physics step
+     * @param threads threads to split the fleet across, 0 to use all the cores
+     */
+    void step(float deltaT, unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunks = std::min<size_t>(threads, (size() + MIN_DRONES_PER_THREAD - 1) / MIN_DRONES_PER_THREAD);
+        if (chunks <= 1) {
+            stepRange(0, size(), deltaT);
+            return;
+        }
+        if (!workers || workers->size() != threads - 1) workers = std::make_unique<ThreadPool>(threads - 1);
+        // drones don't interact with each other: every chunk is independent
+        size_t chunkSize = (size() + chunks - 1) / chunks;
+        std::vector<std::future<void>> stepped;
+        stepped.reserve(chunks - 1);
+        for (size_t c = 1; c < chunks; ++c) {
+            size_t begin = c * chunkSize;
+            size_t end = std::min(size(), begin + chunkSize);
+            stepped.push_back(workers->submit([this, begin, end, deltaT] { stepRange(begin, end, deltaT); }));
+        }
+        stepRange(0, std::min(size(), chunkSize), deltaT);
+        for (auto& chunk : stepped) chunk.get();
+    }
+
+    /**
+     * same as Plane::computeWorldMatrix for a drone of the fleet
+     */
+    glm::mat4 computeWorldMatrix(size_t index, float alpha) const {
+        glm::vec3 previous{previousX[index], previousY[index], previousZ[index]};
+        glm::vec3 current{px[index], py[index], pz[index]};
+        return glm::translate(glm::mat4(1), glm::mix(previous, current, alpha)) *
+               glm::toMat4(glm::slerp(previousRotation[index], rotation[index], alpha)) *
+               glm::scale(glm::mat4(1), glm::vec3(Plane::PLANE_SCALE));
+    }
+
+    void resetState(size_t index) {
+        px[index] = previousX[index] = initialPosition[index].x;
+        py[index] = previousY[index] = initialPosition[index].y;
+        pz[index] = previousZ[index] = initialPosition[index].z;
+        vx[index] = Plane::INITIAL_SPEED.x;
+        vy[index] = Plane::INITIAL_SPEED.y;
+        vz[index] = Plane::INITIAL_SPEED.z;
+        rotation[index] = previousRotation[index] = glm::identity<glm::quat>();
+        dampedRoll[index] = dampedYaw[index] = dampedPitch[index] = 0;
+        meshHistory[index] = 0;
+        hasHistory[index] = 0;
+    }
+
+    glm::vec3 getPositionInWorldCoordinates(size_t index) const {
+        return {px[index], py[index], pz[index]};
+    }
+
+    glm::vec3 getSpeedInWorldCoordinates(size_t index) const {
+        return {vx[index], vy[index], vz[index]};
+    }
+
+    /**
+     * same as Plane::isCollisionDetected for a drone of the fleet
+     */
+    bool isCollisionDetected(size_t index) const {
+        return collision[index] == MESH;
+    }
+};
+
+#endif //DRONE_DELIVERY_DRONEFLEET_HPP
@@ -0,0 +1,63 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_FIXEDTIMESTEP_HPP
+#define DRONE_DELIVERY_FIXEDTIMESTEP_HPP
+
+#include <cmath>
+
+/**
+ * Accumulator turning the variable frame time into a number of fixed physics steps, so that the simulation behaves the
+ * same at any frame rate. What is left in the accumulator after the steps tells how far the render time is between the
+ * last two physics states.
+ */
+class FixedTimestep {
+private:
+    const float STEP;
+    const int MAX_SUBSTEPS;
+    float accumulator = 0;
+
+public:
+    /**
+     * @param step duration of a physics step in seconds
+     * @param maxSubsteps steps run at most in a frame: after a very long frame the simulation slows down instead of
+     * running more and more steps to catch up
+     */
+    explicit FixedTimestep(float step = 1.0f / 120.0f, int maxSubsteps = 8) :
+    STEP(step),
+    MAX_SUBSTEPS(maxSubsteps) {}
+
+    /**
+     * adds the frame time to the accumulator
+     * @return number of physics steps to run for this frame
+     */
+    int advance(float deltaT) {
+        accumulator += deltaT;
+        int steps = static_cast<int>(accumulator / STEP);
+        if (steps > MAX_SUBSTEPS) {
+            // the time that can't be simulated is dropped
+            accumulator = std::fmod(accumulator, STEP);
+            return MAX_SUBSTEPS;
+        }
+        accumulator -= static_cast<float>(steps) * STEP;
+        return steps;
+    }
+
+    /**
+     * @return factor in [0, 1) to interpolate between the previous and the current physics state
+     */
+    float getAlpha() const {
+        return accumulator / STEP;
+    }
+
+    float getStep() const {
+        return STEP;
+    }
+
+    void reset() {
+        accumulator = 0;
+    }
+};
+
+#endif //DRONE_DELIVERY_FIXEDTIMESTEP_HPP
@@ -0,0 +1,120 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+// Benchmark of DroneFleet: steps many drones with random controls over a grid of buildings and reports how many
+// drones are stepped per second, on one thread and on all the cores. Before timing, a single drone of the fleet is
+// checked against a Plane given the same inputs. Doesn't need Vulkan: the buildings are flat roofs baked in a raster.
+// usage: fleet-benchmark [drones] [steps] [threads]
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include "DroneFleet.hpp"
+#include "HeightRaster.hpp"
+#include "FixedTimestep.hpp"
+
+/**
+ * roofs of a 4x4 grid of buildings spread over the city footprint
+ */
+std::vector<Triangle> buildingRoofs() {
+    std::vector<Triangle> triangles;
+    for (int x = 0; x < 4; ++x) {
+        for (int z = 0; z < 4; ++z) {
+            float height = 5.0f + 3.0f * static_cast<float>((x + z) % 3);
+            glm::vec3 a{-50 + x * 30, height, -50 + z * 30};
+            glm::vec3 b = a + glm::vec3(10, 0, 0), c = a + glm::vec3(10, 0, 10), d = a + glm::vec3(0, 0, 10);
+            triangles.push_back({a, b, c});
+            triangles.push_back({a, c, d});
+        }
+    }
+    return triangles;
+}
+
+ControlsMapping randomControls(std::mt19937& generator) {
+    std::uniform_int_distribution<int> axis(-1, 1);
+    ControlsMapping controls{};
+    controls.roll = static_cast<float>(axis(generator));
+    controls.yaw = static_cast<float>(axis(generator));
+    controls.pitch = static_cast<float>(axis(generator));
+    controls.speed = 1;
+    return controls;
+}
+
+/**
+ * @return largest distance between a drone of the fleet and a Plane flown with the same inputs
+ */
+float compareWithPlane(const Wing& wing, const Obstacles& obstacles, float deltaT, int steps) {
+    const glm::vec3 start{200, 10, 200}; // away from the buildings: Plane prints every building collision
+    DroneFleet fleet(wing, obstacles);
+    fleet.add(start);
+    Plane plane(wing, obstacles, start);
+    GameState state = PLAYING;
+
+    float maxDistance = 0;
+    for (int s = 0; s < steps; ++s) {
+        // a slow climbing turn, then level flight
+        glm::vec3 m{0, 0, 1};
+        glm::vec3 r{s < steps / 2 ? -0.3f : 0.0f, s < steps / 4 ? 0.5f : 0.0f, 0};
+        UserInputs inputs(deltaT, m, r, false, state);
+        ControlsMapping controls{};
+        controls.map(inputs);
+        plane.updateInputs(&inputs);
+        plane.step(deltaT);
+        fleet.setControls(0, controls);
+        fleet.step(deltaT, 1);
+        maxDistance = std::max(maxDistance, glm::length(plane.getPositionInWorldCoordinates() - fleet.getPositionInWorldCoordinates(0)));
+    }
+    return maxDistance;
+}
+
+double dronesPerSecond(DroneFleet& fleet, std::mt19937& generator, float deltaT, int steps, unsigned threads) {
+    std::chrono::duration<double> elapsed{0};
+    for (int s = 0; s < steps; ++s) {
+        if (s % 120 == 0) { // new controls every second of flight, not timed
+            for (size_t i = 0; i < fleet.size(); ++i) fleet.setControls(i, randomControls(generator));
+        }
+        auto start = std::chrono::steady_clock::now();
+        fleet.step(deltaT, threads);
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    return static_cast<double>(fleet.size()) * steps / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t droneCount = argc > 1 ? std::stoul(argv[1]) : 10000;
+    int steps = argc > 2 ? std::stoi(argv[2]) : 600;
+    unsigned threads = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : std::max(1u, std::thread::hardware_concurrency());
+    const float deltaT = FixedTimestep().getStep();
+
+    LogarithmicWing wing(Plane::MAX_WING_LIFT, Plane::MAX_SPEED, Plane::BASE);
+    HeightRaster obstacles;
+    obstacles.bake(buildingRoofs(), 4, Plane::COLLISION_DISTANCE);
+
+    // the fleet has to fly like the plane before its speed means anything
+    float deviation = compareWithPlane(wing, obstacles, deltaT, 1200);
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> footprint(-60, 60);
+    std::uniform_real_distribution<float> height(0, 20);
+    auto makeFleet = [&](DroneFleet& fleet) {
+        generator.seed(42);
+        for (size_t i = 0; i < droneCount; ++i) fleet.add({footprint(generator), height(generator), footprint(generator)});
+    };
+
+    DroneFleet single(wing, obstacles);
+    makeFleet(single);
+    double singleRate = dronesPerSecond(single, generator, deltaT, steps, 1);
+    DroneFleet parallel(wing, obstacles);
+    makeFleet(parallel);
+    double parallelRate = dronesPerSecond(parallel, generator, deltaT, steps, threads);
+
+    std::cout << droneCount << " drones, " << steps << " steps of " << deltaT << " s\n";
+    std::cout << "max distance from Plane: " << deviation << "\n";
+    std::cout << "1 thread:   " << singleRate << " drones stepped per second\n";
+    std::cout << threads << " threads: " << parallelRate << " drones stepped per second ("
+              << parallelRate / singleRate << "x)\n";
+    return deviation < 1e-2f ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,145 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_FRUSTUM_HPP
+#define DRONE_DELIVERY_FRUSTUM_HPP
+
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/**
+ * Axis aligned box and sphere around the vertices of a model, in model coordinates. The sphere is centered in the box
+ * and is tighter than its half diagonal when it can be: it is the cheap test, the box is the precise one.
+ */
+struct BoundingVolume {
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{- std::numeric_limits<float>::max()};
+    glm::vec3 center{0};
+    float radius = 0;
+
+    /**
+     * @return true if no point was added: nothing is known of the model, so it is never culled
+     */
+    bool isEmpty() const {
+        return min.x > max.x;
+    }
+
+    /**
+     * first pass over the points: grows the box
+     */
+    void add(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+        center = (min + max) * 0.5f;
+    }
+
+    /**
+     * second pass over the same points, once the box is complete: grows the sphere
+     */
+    void fit(const glm::vec3& point) {
+        radius = std::max(radius, glm::length(point - center));
+    }
+
+    /**
+     * union with another volume; the sphere becomes the one around the box
+     */
+    void merge(const BoundingVolume& other) {
+        if (other.isEmpty()) return;
+        add(other.min);
+        add(other.max);
+        radius = glm::length(max - center);
+    }
+
+    BoundingVolume translated(const glm::vec3& offset) const {
+        BoundingVolume moved = *this;
+        moved.min += offset;
+        moved.max += offset;
+        moved.center += offset;
+        return moved;
+    }
+
+    /**
+     * @return the volume in the coordinates of world: the box is the one along the axes around the transformed box,
+     * the sphere is scaled by the largest scale of world
+     */
+    BoundingVolume transformed(const glm::mat4& world) const {
+        if (isEmpty()) return *this;
+        glm::mat3 linear(world);
+        glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+        glm::vec3 extent = absolute * ((max - min) * 0.5f);
+        BoundingVolume moved;
+        moved.center = glm::vec3(world * glm::vec4(center, 1));
+        moved.min = moved.center - extent;
+        moved.max = moved.center + extent;
+        moved.radius = radius * std::max({glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2])});
+        return moved;
+    }
+};
+
+/**
+ * The six planes of a view frustum, extracted from a projection * view matrix (Gribb-Hartmann, with depth in [0, 1] as
+ * GLM_FORCE_DEPTH_ZERO_TO_ONE makes it). Each plane is (normal, distance) with the normal pointing inside.
+ */
+class Frustum {
+private:
+    std::array<glm::vec4, 6> planes;
+
+    static glm::vec4 row(const glm::mat4& m, int i) {
+        return {m[0][i], m[1][i], m[2][i], m[3][i]};
+    }
+
+public:
+    explicit Frustum(const glm::mat4& viewProjection) {
+        planes[0] = row(viewProjection, 3) + row(viewProjection, 0); // left
+        planes[1] = row(viewProjection, 3) - row(viewProjection, 0); // right
+        planes[2] = row(viewProjection, 3) + row(viewProjection, 1); // bottom (top with the y flip of Vulkan)
+        planes[3] = row(viewProjection, 3) - row(viewProjection, 1); // top
+        planes[4] = row(viewProjection, 2);                           // near
+        planes[5] = row(viewProjection, 3) - row(viewProjection, 2); // far
+        for (auto& plane : planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const auto& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < - radius) return false;
+        }
+        return true;
+    }
+
+    /**
+     * box in world coordinates given by its center and half extents
+     */
+    bool intersectsBox(const glm::vec3& center, const glm::vec3& extent) const {
+        for (const auto& plane : planes) {
+            glm::vec3 normal(plane);
+            if (glm::dot(normal, center) + plane.w < - glm::dot(glm::abs(normal), extent)) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @param world world matrix the volume is drawn with
+     * @return false only if the volume is entirely outside the frustum
+     */
+    bool isVisible(const BoundingVolume& bounds, const glm::mat4& world) const {
+        if (bounds.isEmpty()) return true;
+        BoundingVolume worldBounds = bounds.transformed(world);
+        return intersectsSphere(worldBounds.center, worldBounds.radius) &&
+               intersectsBox(worldBounds.center, (worldBounds.max - worldBounds.min) * 0.5f);
+    }
+
+    /**
+     * planes as (normal, distance), e.g. to test the volumes on the GPU
+     */
+    const std::array<glm::vec4, 6>& getPlanes() const {
+        return planes;
+    }
+};
+
+#endif //DRONE_DELIVERY_FRUSTUM_HPP
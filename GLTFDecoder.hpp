@@ -0,0 +1,145 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_GLTFDECODER_HPP
+#define DRONE_DELIVERY_GLTFDECODER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// images embedded in the models are never used (textures are loaded separately), so tinygltf doesn't need stb
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NOEXCEPTION
+#define JSON_NOEXCEPTION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include <tiny_gltf.h>
+
+#include <plusaes.hpp>
+
+#define SINFL_IMPLEMENTATION
+#include <sinfl.h>
+
+/**
+ * Decoding of glTF and MGCG (encrypted and deflated glTF) models into a tinygltf::Model.
+ * Doesn't depend on Vulkan, so the models can also be read by targets without a GPU.
+ */
+
+/**
+ * image loader that leaves the images empty: the models only provide geometry
+ */
+inline bool skipGLTFImage(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*) {
+    return true;
+}
+
+/**
+ * @param file path of the model
+ * @param encoded true for MGCG models
+ * @param model filled with the decoded model
+ */
+inline void decodeGLTF(const std::string& file, bool encoded, tinygltf::Model& model) {
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(skipGLTFImage, nullptr);
+    std::string warn, err;
+
+    if (encoded) {
+        std::ifstream stream(file, std::ios::ate | std::ios::binary);
+        if (!stream.is_open()) {
+            std::cout << "Failed to open: " << file << "\n";
+            throw std::runtime_error("failed to open file!");
+        }
+        std::vector<char> modelString(static_cast<size_t>(stream.tellg()));
+        stream.seekg(0);
+        stream.read(modelString.data(), static_cast<std::streamsize>(modelString.size()));
+
+        const std::vector<unsigned char> key = plusaes::key_from_string(&"CG2023SkelKey128"); // 16-char = 128-bit
+        const unsigned char iv[16] = {
+                0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        };
+
+        // decrypt
+        unsigned long paddedSize = 0;
+        std::vector<unsigned char> decrypted(modelString.size());
+        plusaes::decrypt_cbc((unsigned char*) modelString.data(), modelString.size(), &key[0], key.size(), &iv,
+                             &decrypted[0], decrypted.size(), &paddedSize);
+
+        // the first 16 bytes hold the inflated size as text
+        int size = 0;
+        sscanf(reinterpret_cast<const char*>(&decrypted[0]), "%d", &size);
+        std::vector<char> inflated(size);
+        sinflate(inflated.data(), size, &decrypted[16], static_cast<int>(decrypted.size()) - 16);
+
+        if (!loader.LoadASCIIFromString(&model, &warn, &err, inflated.data(), size, "/")) {
+            throw std::runtime_error(warn + err);
+        }
+    } else {
+        if (!loader.LoadASCIIFromFile(&model, &warn, &err, file)) {
+            throw std::runtime_error(warn + err);
+        }
+    }
+}
+
+/**
+ * reads only the positions and the indices of a model, laid out as the renderer lays them out
+ * @param vertices only the pos member of the vertices is written
+ */
+template<class Vert>
+void loadGLTFPositions(const std::string& file, bool encoded, std::vector<Vert>& vertices, std::vector<uint32_t>& indices) {
+    tinygltf::Model model;
+    decodeGLTF(file, encoded, model);
+
+    for (const auto& mesh : model.meshes) {
+        for (const auto& primitive : mesh.primitives) {
+            if (primitive.indices < 0) continue;
+
+            const float* bufferPos = nullptr;
+            int cntPos = 0;
+            int cntTot = 0;
+            for (const auto& attribute : primitive.attributes) {
+                const tinygltf::Accessor& accessor = model.accessors[attribute.second];
+                if (attribute.first == "POSITION") {
+                    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+                    bufferPos = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+                    cntPos = static_cast<int>(accessor.count);
+                }
+                // the renderer makes a vertex for each element of the longest of the attributes it reads
+                if (attribute.first == "POSITION" || attribute.first == "NORMAL" ||
+                    attribute.first == "TANGENT" || attribute.first == "TEXCOORD_0") {
+                    cntTot = std::max(cntTot, static_cast<int>(accessor.count));
+                }
+            }
+
+            for (int i = 0; i < cntTot; i++) {
+                Vert vertex{};
+                if (i < cntPos) vertex.pos = {bufferPos[3 * i + 0], bufferPos[3 * i + 1], bufferPos[3 * i + 2]};
+                vertices.push_back(vertex);
+            }
+
+            const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
+            const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+            const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+            const unsigned char* data = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+            switch (accessor.componentType) {
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+                    for (size_t i = 0; i < accessor.count; i++) indices.push_back(reinterpret_cast<const uint16_t*>(data)[i]);
+                    break;
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+                    for (size_t i = 0; i < accessor.count; i++) indices.push_back(reinterpret_cast<const uint32_t*>(data)[i]);
+                    break;
+                default:
+                    std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
+                    throw std::runtime_error("Error loading GLTF component");
+            }
+        }
+    }
+}
+
+#endif //DRONE_DELIVERY_GLTFDECODER_HPP
@@ -1,11 +1,13 @@
 // This has been adapted from the Vulkan tutorial
 
 #include "Starter.hpp"
-#include "Plane.hpp"
-#include "UserInputs.hpp"
-#include "Package.hpp"
 #include "DataStructs.hpp"
 #include "UserModelPool.hpp"
+#include "GameLogic.hpp"
+#include "InputRecording.hpp"
+#include "LevelOfDetail.hpp"
+#include "ThreadPool.hpp"
+#include <numeric>
 
 // MAIN ! 
 class Game : public BaseProject {
@@ -15,13 +17,13 @@ class Game : public BaseProject {
 	float Ar;
 
 	// Descriptor Layouts ["classes" of what will be passed to the shaders]
-	DescriptorSetLayout DSLGubo, DSLMetallic, DSLOpaque, DSLEmit, DSLOverlay, DSLPropeller;
+	DescriptorSetLayout DSLGubo, DSLMetallic, DSLOpaque, DSLCity, DSLEmit, DSLOverlay, DSLPropeller;
 
 	// Vertex formats
-	VertexDescriptor VClassic, VOverlay, VAnimation;
+	VertexDescriptor VClassic, VClassicInstanced, VOverlay, VAnimation;
 
 	// Pipelines [Shader couples]
-	Pipeline PMetallic, POpaque, PEmit, POverlay, PPropeller;
+	Pipeline PMetallic, POpaque, PCity, PEmit, POverlay, PPropeller;
 
 	// Models, textures and Descriptors (values assigned to the uniforms)
 	// Please note that Model objects depends on the corresponding vertex structure
@@ -29,32 +31,58 @@ class Game : public BaseProject {
 	Model<VertexClassic> MBox, MGround;
 	std::array<Model<VertexClassic>, 12> MCity;
     Model<VertexClassic> MRoad, MStreet; /** use instanced-rendering **/
-	Model<VertexOverlay> MScore, MLife, MSplash, MWin, MLose, MHelp; /** score and life use instanced-rendering **/
+    GeometryPool<VertexClassic> GClassic; /** buffers of all the VertexClassic models, bound once per frame **/
+    GeometryRange RPlane, RArrow, RBox, RGround, RRoad, RStreet;
+    static const int CITY_LODS = 4;
+    std::array<std::array<GeometryRange, CITY_LODS>, 12> RCity; /** levels of detail of each block, 0 is the model **/
+    std::array<int, 12> cityLods{}; /** level drawn for each block **/
+    const float LOD_RATIO = 0.5f; // of the triangles of the level before
+    const float LOD_ERROR = 0.01f; // of the radius of a block, per level
+    // half of the screen height (a block's projected radius) under which the next level is drawn
+    const std::array<float, CITY_LODS - 1> LOD_SCREEN_SIZES = {0.6f, 0.35f, 0.2f};
+    const float LOD_HYSTERESIS = 0.15f;
+    InstanceBuffer<InstanceTransform> emitInstances; /** transforms of the instances of road and street **/
+    uint32_t roadFirstInstance = 0, streetFirstInstance = 0; /** of each in emitInstances **/
+    IndirectDrawBuffer cityDraws; /** city blocks in view, drawn by a single indirect draw **/
+    GpuCulling gpuCulling; /** when supported, culls the city, road and street on the GPU instead of cityDraws **/
+    const uint32_t CITY_DRAWS = 0; // draw lists of gpuCulling
+    const uint32_t ROAD_DRAWS = 1;
+    const uint32_t STREET_DRAWS = 2;
+    const float CULLING_DISTANCE = 0; // farther objects are culled on the GPU, 0 to cull only against the frustum
+    DepthPyramid depthPyramid; /** depth of the last frame: gpuCulling skips the city blocks hidden in it **/
+    bool printCullingStatistics = false; /** --culling-statistics: gpuCulling counters printed every second **/
+    Logger cullingLogger{std::cout};
+	Model<VertexOverlay> MOverlay; /** unit quad: every overlay is an instance of it **/
+	TextureAtlas overlayAtlas; /** images of all the overlays: they share DSOverlay and a single draw **/
+	InstanceBuffer<OverlayInstance> overlayInstances; /** visible overlays of the frame **/
 	Model<VertexAnimation> MPropeller;
-	DescriptorSet DSGubo, DSPlane, DSArrow, DSBox, DSScore, DSLife, DSSplash, DSWin, DSLose, DSGround, DSHelp, DSRoad, DSStreet, DSPropeller; /** one per instance of model (if not using instanced-rendering)**/
-	std::array<DescriptorSet, 12> DSCity;
-	Texture TCity, TArrow, TGround, TScore, TLife, TSplash, TWin, TLose, THelp, TEmit;
+	DescriptorSet DSGubo, DSPlane, DSArrow, DSOverlay, DSGround, DSRoad, DSStreet, DSPropeller; /** one per instance of model (if not using instanced-rendering)**/
+	DescriptorSet DSOpaque; /** city blocks and box: share the texture, the material of each is at a dynamic offset **/
+	DescriptorSet DSCity; /** transforms of all the city blocks **/
+	Texture TCity, TArrow, TGround, TEmit;
 	
 	// C++ storage for uniform variables
 	MetallicUniformBlock uboPlane, uboArrow;
     OpaqueUniformBlock uboBox, uboGround;
-    std::array<OpaqueUniformBlock, 12> uboCity;
+    OpaqueUniformBlock uboCity; // all the city blocks share the material
+    ModelPushConstants pushPlane, pushArrow, pushBox, pushGround; /** transforms of metallic and opaque objects, pushed with their draw **/
+    CityUniformBlock uboCityTransforms;
+    const int CITY_OPAQUE_INDEX = 0; // index of the blocks in DSOpaque
+    const int BOX_OPAQUE_INDEX = 1;
     EmitUniformBlock uboRoad, uboStreet;
 	GlobalUniformBlock gubo;
-	OverlayUniformBlock uboScore, uboLife, uboSplash, uboWin, uboLose, uboHelp;
+	std::array<OverlayElement, 6> overlays; /** in the order they are drawn, one after the other **/
     AnimationUniformBlock uboPropeller;
 
-	GameState gameState = SPLASH;
-    glm::vec3 targetPos;
-    // moving target random range: values that make it land inside ground
-    const int RANGE = 120; // target random position xz range
-    const int START = -60; // starting value
-    std::vector<glm::vec3> collisionDetectionVertices;
+    BoundingVolume roadBounds, streetBounds; /** around all the instances of the road and street draws **/
+    bool boxVisible = true, arrowVisible = true, roadVisible = true, streetVisible = true;
+    std::array<glm::vec4, 6> frustumPlanes{}; /** of the last frame, for gpuCulling: all zero planes cull nothing **/
+    glm::mat4 viewProjection{1}; /** of the last frame, the depth pyramid is reprojected with it **/
 
-    // city blocks parameters
-    const vec3 CITY_STARTING_POS = {-36, 0, -48}; // centers city in the square 120x120 map
-    const int CITY_OFFSET = 24; // distance between buildings
-    const int CITY_DIM = 3; // in our case 3x4 city so every 3 blocks jump to next row
+    GameLogic logic; // state machine, physics, score and lives: everything that isn't rendering
+    std::string recordPath, replayPath;
+    InputRecorder recorder;
+    InputPlayer player;
 
     const int ROAD_INSTANCES = 6;
     const vec3 ROAD_STARTING_POSITION = {48, 0.15, 48};
@@ -66,32 +94,23 @@ class Game : public BaseProject {
     const vec3 STREET_OFFSET = {- 8.0f, 0, 24};
     const int STREET_ROWS = 12;
 
+    const int OVERLAY_SCORE = 0; // in overlays and in overlayAtlas
+    const int OVERLAY_LIFE = 1;
+    const int OVERLAY_SPLASH = 2;
+    const int OVERLAY_WIN = 3;
+    const int OVERLAY_LOSE = 4;
+    const int OVERLAY_HELP = 5;
+    const std::array<const char*, 6> OVERLAY_TEXTURES = {"textures/BoxScore.jpg", "textures/life.png",
+            "textures/splash.png", "textures/win.png", "textures/lose.png", "textures/help.png"};
+    const int OVERLAY_INSTANCES = GameLogic::WINNING_SCORE + GameLogic::STARTING_LIVES + 4;
+
     const float SCORE_OFFSET = 0.15;
     const glm::vec2 SCORE_BOTTOM_LEFT = {-0.9f, 0.8f};
     const float SCORE_WIDTH = 0.10;
     const float LIFE_DISTANCE = -0.2;
-    const int WINNING_SCORE = 5; /** or if instances are identical use INSTANCED RENDERING! sharing DS **/
-    const int STARTING_LIVES = 3;
-
     const int PROPELLER_INSTANCES = 2;
     const vec3 PROPELLER_OFFSET = {22.5, 0, 0};
 
-    const vec3 PLANE_STARTING_POS = {48, 0, 0}; // starts in middle of long side offset to the side
-
-    LogarithmicWing wingImplementation = LogarithmicWing(Plane::MAX_WING_LIFT, Plane::MAX_SPEED, Plane::BASE);
-    Plane plane = Plane(wingImplementation, collisionDetectionVertices, PLANE_STARTING_POS);
-    Package box = Package(plane.getPositionInWorldCoordinates(), plane.getSpeedInWorldCoordinates(), targetPos);
-    int score = 0;
-    int lives = STARTING_LIVES;
-
-    /**
-     * computes the translation vector for a given model among the city models
-     * @param index of the model for which to compute the translation
-     */
-    vec3 computeCityTranslation(int index) {
-        return CITY_STARTING_POS + vec3{(index % CITY_DIM) * CITY_OFFSET, 0, (index / CITY_DIM) * CITY_OFFSET};
-    }
-
 	// Here you set the main application parameters
 	void setWindowParameters() {
 		// window size, titile and initial background
@@ -102,9 +121,10 @@ class Game : public BaseProject {
 		initialBackgroundColor = {0.0f, 0.06f, 0.4f, 1.0f};
 		
 		// Descriptor pool sizes
-		uniformBlocksInPool = 31;
-		texturesInPool = 30;
-		setsInPool = 31;
+		uniformBlocksInPool = 7;
+		dynamicUniformBlocksInPool = 2;
+		texturesInPool = 9;
+		setsInPool = 10;
 		
 		Ar = (float)windowWidth / (float)windowHeight;
 	}
@@ -115,33 +135,31 @@ class Game : public BaseProject {
 	}
 
     void initGameLogic() {
-        gameState = SPLASH;
-        targetPos.x = static_cast<float>(rand() % RANGE + START);
-        targetPos.y = 0;
-        targetPos.z = static_cast<float>(rand() % RANGE + START);
+        std::vector<Triangle> cityTriangles;
         for (int i = 0; i < MCity.size(); ++i) {
-            for (auto v : MCity[i].vertices) {
-                collisionDetectionVertices.push_back(
-                        v.pos + computeCityTranslation(i));
-            }
+            appendTriangles(cityTriangles, MCity[i].vertices, MCity[i].indices, GameLogic::computeCityTranslation(i));
+        }
+
+        unsigned int seed = GameLogic::DEFAULT_SEED;
+        if (!replayPath.empty()) {
+            player.open(replayPath);
+            seed = player.getSeed();
         }
+        if (!recordPath.empty()) recorder.open(recordPath, seed);
+        logic.init(cityTriangles, seed);
     }
 
     /**
      * computes fixed components of ubos only once instead of re-computing them at every frame (e.g. world matrices of fixed objects)
      */
     void initUniforms() {
-        uboSplash.mvpMat = glm::mat4(1);
-        uboSplash.instancesToDraw = 1.0;
-
         gubo.DlightDir = glm::normalize(glm::vec3(1, 2, 3));
         gubo.DlightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
         gubo.AmbLightColor = glm::vec3(0.9f);
 
+        uboCity.amb = 1.0f; uboCity.sigma = 1.1;
         for (int i = 0; i < MCity.size(); ++i) {
-            uboCity[i].amb = 1.0f; uboCity[i].sigma = 1.1;
-            uboCity[i].mMat = translate(mat4(1), computeCityTranslation(i));
-            uboCity[i].nMat = glm::inverse(glm::transpose(uboCity[i].mMat));
+            uboCityTransforms.blocks[i].mMat = translate(mat4(1), GameLogic::computeCityTranslation(i));
         }
 
         uboPlane.amb = 1.0f; uboPlane.gamma = 180.0f; uboPlane.sColor = glm::vec3(1.0f);
@@ -155,36 +173,26 @@ class Game : public BaseProject {
                 * translate(mat4(1), ROAD_STARTING_POSITION);
         uboRoad.amb = 1.0f; uboRoad.sigma = 1.1;
         uboRoad.nMat = glm::inverse(glm::transpose(uboRoad.mMat));
-        uboRoad.offset = ROAD_OFFSET;
-        uboRoad.dim = static_cast<float>(ROAD_ROWS);
 
         uboStreet.mMat =
                 glm::rotate(mat4(1.0f), glm::radians(90.0f), vec3(0,1,0))
                 * translate(mat4(1), STREET_STARTING_POSITION);
         uboStreet.amb = 1.0f; uboStreet.sigma = 1.1;
         uboStreet.nMat = glm::inverse(glm::transpose(uboStreet.mMat));
-        uboStreet.offset = STREET_OFFSET;
-        uboStreet.dim = static_cast<float>(STREET_ROWS);
 
         /* high gamma makes the ground less shiny and sColor specular reflection color is set to dark green */
         uboGround.amb = 1.0f; uboGround.sigma = 1.1;
-        uboGround.mMat = mat4(1);
-        uboGround.nMat = glm::inverse(glm::transpose(uboGround.mMat));
-
-        uboScore.mvpMat = mat4(1);
-        uboScore.offset = {SCORE_OFFSET, 0}; /** offset between identical instances **/
-
-        uboLife.mvpMat = glm::translate(glm::mat4(1), glm::vec3(0, LIFE_DISTANCE, 0));
-        uboLife.offset = {SCORE_OFFSET, 0}; /** offset between identical instances **/
-
-        uboHelp.mvpMat = mat4(1);
-        uboHelp.instancesToDraw = 1.0;
+        pushGround.mMat = mat4(1);
 
-        uboWin.mvpMat = mat4(1);
-        uboWin.instancesToDraw = 1.0;
+        for (int i = 0; i < overlays.size(); ++i) {
+            overlays[i].atlasImage = i; // OVERLAY_TEXTURES has the same order, the rectangle is the screen by default
+        }
+        float scoreHeight = Ar * SCORE_WIDTH; // to make score images square
+        overlays[OVERLAY_SCORE].rect = {SCORE_BOTTOM_LEFT, SCORE_BOTTOM_LEFT + glm::vec2(SCORE_WIDTH, scoreHeight)};
+        overlays[OVERLAY_SCORE].offset = {SCORE_OFFSET, 0}; /** offset between identical instances **/
 
-        uboLose.mvpMat = mat4(1);
-        uboLose.instancesToDraw = 1.0;
+        overlays[OVERLAY_LIFE].rect = overlays[OVERLAY_SCORE].rect + glm::vec4(0, LIFE_DISTANCE, 0, LIFE_DISTANCE);
+        overlays[OVERLAY_LIFE].offset = {SCORE_OFFSET, 0};
 
         uboPropeller.offset = PROPELLER_OFFSET;
         uboPropeller.time = 0.0;
@@ -208,10 +216,14 @@ class Game : public BaseProject {
 				});
 
         DSLOpaque.init(this, {
-                {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
+                {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS},
                 {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT}
         });
 
+        DSLCity.init(this, {
+                {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
+        });
+
         DSLEmit.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
                 {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT},
@@ -219,8 +231,7 @@ class Game : public BaseProject {
         });
 				
 		DSLOverlay.init(this, {
-					{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
-					{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT}
+					{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT}
 				});
 
         DSLPropeller.init(this, {
@@ -268,13 +279,39 @@ class Game : public BaseProject {
 				         sizeof(glm::vec2), UV}
 				});
 
+		// VertexClassic models drawn with a transform per instance: the matrix takes a location per column
+		VClassicInstanced.init(this, {
+				  {0, sizeof(VertexClassic), VK_VERTEX_INPUT_RATE_VERTEX},
+				  {1, sizeof(InstanceTransform), VK_VERTEX_INPUT_RATE_INSTANCE}
+				}, {
+				  {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexClassic, pos),
+				         sizeof(glm::vec3), POSITION},
+				  {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexClassic, norm),
+				         sizeof(glm::vec3), NORMAL},
+				  {0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexClassic, UV),
+				         sizeof(glm::vec2), UV},
+				  {1, 3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceTransform, mMat),
+				         sizeof(glm::vec4), OTHER},
+				  {1, 4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceTransform, mMat) + sizeof(glm::vec4),
+				         sizeof(glm::vec4), OTHER},
+				  {1, 5, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceTransform, mMat) + 2 * sizeof(glm::vec4),
+				         sizeof(glm::vec4), OTHER},
+				  {1, 6, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceTransform, mMat) + 3 * sizeof(glm::vec4),
+				         sizeof(glm::vec4), OTHER}
+				});
+
 		VOverlay.init(this, {
-				  {0, sizeof(VertexOverlay), VK_VERTEX_INPUT_RATE_VERTEX}
+				  {0, sizeof(VertexOverlay), VK_VERTEX_INPUT_RATE_VERTEX},
+				  {1, sizeof(OverlayInstance), VK_VERTEX_INPUT_RATE_INSTANCE}
 				}, {
 				  {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexOverlay, pos),
 				         sizeof(glm::vec2), OTHER},
 				  {0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexOverlay, UV),
-				         sizeof(glm::vec2), UV}
+				         sizeof(glm::vec2), UV},
+				  {1, 2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(OverlayInstance, rect),
+				         sizeof(glm::vec4), OTHER},
+				  {1, 3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(OverlayInstance, region),
+				         sizeof(glm::vec4), OTHER}
 				});
 
         VAnimation.init(this, {
@@ -294,16 +331,21 @@ class Game : public BaseProject {
                                       VK_CULL_MODE_BACK_BIT, true);
         // default advanced features: VK_COMPARE_OP_LESS, VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, false
         POpaque.init(this, &VClassic, "shaders/OpaqueVert.spv", "shaders/OpaqueFrag.spv", {&DSLGubo, &DSLOpaque});
+        PCity.init(this, &VClassic, "shaders/OpaqueCityVert.spv", "shaders/OpaqueFrag.spv", {&DSLGubo, &DSLOpaque, &DSLCity});
         /** back-face culling cuts groud for all assets with attached ground (park & roller coaster): consider enabling **/
-        PEmit.init(this, &VClassic, "shaders/EmitVert.spv", "shaders/EmitFrag.spv", {&DSLGubo, &DSLEmit});
+        PEmit.init(this, &VClassicInstanced, "shaders/EmitVert.spv", "shaders/EmitFrag.spv", {&DSLGubo, &DSLEmit});
         PEmit.setAdvancedFeatures(VK_COMPARE_OP_LESS, VK_POLYGON_MODE_FILL,
                                     VK_CULL_MODE_NONE, false); /** ROAD TILES REQUIRE NO BACK-FACE CULLING **/
 		POverlay.init(this, &VOverlay, "shaders/OverlayVert.spv", "shaders/OverlayFrag.spv", {&DSLOverlay});
 		POverlay.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL,
  								    VK_CULL_MODE_NONE, true);
+        POverlay.setDepthWrite(false); // drawn last: their depth would hide the city from the depth pyramid
         PPropeller.init(this, &VAnimation, "shaders/AnimationVert.spv", "shaders/AnimationFrag.spv", {&DSLPropeller});
         PPropeller.setAdvancedFeatures(VK_COMPARE_OP_LESS, VK_POLYGON_MODE_FILL,
                                        VK_CULL_MODE_BACK_BIT, true);
+        // per-draw transforms of metallic and opaque objects
+        PMetallic.addPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ModelPushConstants));
+        POpaque.addPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ModelPushConstants));
 
 		// Models, textures and Descriptors (values assigned to the uniforms)
 
@@ -311,16 +353,41 @@ class Game : public BaseProject {
 		// The second parameter is the pointer to the vertex definition for this model
 		// The third parameter is the file name
 		// The last is a constant specifying the file type: currently only OBJ or GLTF
+        // the files are decrypted, parsed and decoded on all the cores, and the levels of detail of the city built (or
+        // read from their cache) there too: only the creation of the buffers and images, after all of them, stays on this thread
+        std::array<std::vector<std::vector<uint32_t>>, 12> cityLevels;
+        std::vector<std::function<void()>> loaders;
         for (int i = 0; i < MCity.size(); ++i) {
-            std::string modelFile = "models/city_" + std::to_string(i) + ".mgcg";
-            MCity[i].init(this, &VClassic, modelFile, MGCG);
+            loaders.emplace_back([this, i, &cityLevels] {
+                std::string modelFile = "models/city_" + std::to_string(i) + ".mgcg";
+                MCity[i].load(this, &VClassic, modelFile, MGCG);
+                bool cached;
+                cityLevels[i] = loadOrBuildLodChain(MeshCache::levelsFile(modelFile), MCity[i].vertices,
+                                                    MCity[i].indices, CITY_LODS, LOD_RATIO,
+                                                    LOD_ERROR * MCity[i].bounds.radius, cached);
+                TaskLog::stream() << "Levels of detail : " << modelFile << (cached ? "[cache]" : "[built]") << "\n";
+            });
         }
+        loaders.emplace_back([this] { MPlane.load(this, &VClassic, "models/plane_001.mgcg", MGCG); });
+        loaders.emplace_back([this] { MArrow.load(this, &VClassic, "models/tube.obj", OBJ); });
+        loaders.emplace_back([this] { MBox.load(this, &VClassic, "models/box_005.mgcg", MGCG); });
+        loaders.emplace_back([this] { MRoad.load(this, &VClassic, "models/road_0.mgcg", MGCG); });
+        loaders.emplace_back([this] { MStreet.load(this, &VClassic, "models/street_0.mgcg", MGCG); });
+        loaders.emplace_back([this] { MPropeller.load(this, &VAnimation, "models/propeller_animation.obj", OBJ); });
+        // The second parameter is the file name
+        loaders.emplace_back([this] { TCity.load(this, "textures/Textures_City.png"); });
+        loaders.emplace_back([this] { TArrow.load(this, "textures/tube.png"); });
+        loaders.emplace_back([this] { TGround.load(this, "textures/grass.jpg"); });
+        loaders.emplace_back([this] {
+            overlayAtlas.load(this, std::vector<std::string>(OVERLAY_TEXTURES.begin(), OVERLAY_TEXTURES.end()),
+                              "textures/overlays.ktx2");
+        });
+        loaders.emplace_back([this] { TEmit.load(this, "textures/city_emit.png"); });
+        runLoaders(loaders);
 
-		MPlane.init(this, &VClassic, "models/plane_001.mgcg", MGCG);
-        MArrow.init(this, &VClassic, "models/tube.obj", OBJ);
-        MBox.init(this, &VClassic, "models/box_005.mgcg", MGCG);
-        MRoad.init(this, &VClassic, "models/road_0.mgcg", MGCG);
-        MStreet.init(this, &VClassic, "models/street_0.mgcg", MGCG);
+        roadBounds = computeInstancesBounds(MRoad.bounds, gridTransforms(ROAD_OFFSET, ROAD_ROWS, ROAD_INSTANCES));
+        streetBounds = computeInstancesBounds(MStreet.bounds,
+                                              gridTransforms(STREET_OFFSET, STREET_ROWS, STREET_INSTANCES));
 
         // MGround.init(this, &VMesh, "models/ground.mgcg", MGCG);
         MGround.vertices = {{{-64, 0, -64}, {0, 1, 0}, {0, 0}},
@@ -328,51 +395,39 @@ class Game : public BaseProject {
                             {{ 64, 0, -64}, {0, 1, 0}, {0, 10}},
                             {{ 64, 0,  64}, {0, 1, 0}, {10, 10}}}; // give UVs values >1 to repeat the texture
         MGround.indices = {0, 1, 2, 1, 3, 2};
-        MGround.initMesh(this, &VClassic);
-
-        float scoreHeight = Ar * SCORE_WIDTH; // to make score images square
-		MScore.vertices = {{SCORE_BOTTOM_LEFT, {0.0f, 0.0f}}, {{SCORE_BOTTOM_LEFT.x, SCORE_BOTTOM_LEFT.y + scoreHeight}, {0.0f, 1.0f}},
-                           {{SCORE_BOTTOM_LEFT.x + SCORE_WIDTH, SCORE_BOTTOM_LEFT.y}, {1.0f, 0.0f}}, {{SCORE_BOTTOM_LEFT.x + SCORE_WIDTH, SCORE_BOTTOM_LEFT.y + scoreHeight}, {1.0f, 1.0f}}};
-        MScore.indices = {0, 1, 2, 1, 2, 3};
-		MScore.initMesh(this, &VOverlay);
-
-        MLife.vertices = {{SCORE_BOTTOM_LEFT, {0.0f, 0.0f}}, {{SCORE_BOTTOM_LEFT.x, SCORE_BOTTOM_LEFT.y + scoreHeight}, {0.0f, 1.0f}},
-                           {{SCORE_BOTTOM_LEFT.x + SCORE_WIDTH, SCORE_BOTTOM_LEFT.y}, {1.0f, 0.0f}}, {{SCORE_BOTTOM_LEFT.x + SCORE_WIDTH, SCORE_BOTTOM_LEFT.y + scoreHeight}, {1.0f, 1.0f}}};
-        MLife.indices = {0, 1, 2, 1, 2, 3};
-        MLife.initMesh(this, &VOverlay);
-		
-		// Creates a mesh with direct enumeration of vertices and indices
-		MSplash.vertices = {{{-1, -1}, {0, 0}}, {{-1, 1}, {0, 1}},
-						 {{ 1,-1}, {1, 0}}, {{ 1, 1}, {1, 1}}};
-		MSplash.indices = {0, 1, 2,    1, 2, 3};
-		MSplash.initMesh(this, &VOverlay);
+        MGround.loadMesh(this, &VClassic);
 
-        MWin.vertices = MSplash.vertices;
-        MWin.indices = MSplash.indices;
-        MWin.initMesh(this, &VOverlay);
-
-        MLose.vertices = MSplash.vertices;
-        MLose.indices = MSplash.indices;
-        MLose.initMesh(this, &VOverlay);
-
-        MHelp.vertices = MSplash.vertices;
-        MHelp.indices = MSplash.indices;
-        MHelp.initMesh(this, &VOverlay);
-
-        MPropeller.init(this, &VAnimation, "models/propeller_animation.obj", OBJ);
+        // the VertexClassic models have no buffers of their own: they are all drawn from the pool
+        for (int i = 0; i < MCity.size(); ++i) {
+            RCity[i][0] = GClassic.add(MCity[i]);
+            for (int level = 1; level < CITY_LODS; ++level) {
+                RCity[i][level] = GClassic.addLevel(RCity[i][0], cityLevels[i][level]);
+            }
+        }
+        RPlane = GClassic.add(MPlane);
+        RArrow = GClassic.add(MArrow);
+        RBox = GClassic.add(MBox);
+        RRoad = GClassic.add(MRoad);
+        RStreet = GClassic.add(MStreet);
+        RGround = GClassic.add(MGround);
+        // nothing in the pool changes after loading: it is only read by the GPU, from its own memory
+        GClassic.create(this, DEVICE_LOCAL);
+
+		// Creates a mesh with direct enumeration of vertices and indices: each instance stretches it on its rectangle
+		MOverlay.vertices = {{{0, 0}, {0, 0}}, {{0, 1}, {0, 1}},
+						 {{1, 0}, {1, 0}}, {{1, 1}, {1, 1}}};
+		MOverlay.indices = {0, 1, 2,    1, 2, 3};
+		MOverlay.initMesh(this, &VOverlay);
+
+        MPropeller.createVertexBuffer();
+        MPropeller.createIndexBuffer();
 		
 		// Create the textures
-		// The second parameter is the file name
-		TCity.init(this, "textures/Textures_City.png");
-        TArrow.init(this, "textures/tube.png");
-        TGround.init(this, "textures/grass.jpg");
-		TScore.init(this, "textures/BoxScore.jpg");
-        TLife.init(this, "textures/life.png");
-		TSplash.init(this, "textures/splash.png");
-        TWin.init(this, "textures/win.png");
-        TLose.init(this, "textures/lose.png");
-        THelp.init(this, "textures/help.png");
-        TEmit.init(this, "textures/city_emit.png");
+		TCity.create();
+        TArrow.create();
+        TGround.create();
+        overlayAtlas.create();
+        TEmit.create();
 
 		initGameLogic();
         initUniforms();
@@ -383,14 +438,26 @@ class Game : public BaseProject {
 		// This creates a new pipeline (with the current surface), using its shaders
 		PMetallic.create();
         POpaque.create();
+        PCity.create();
         PEmit.create();
 		POverlay.create();
         PPropeller.create();
 
-        for (auto &dsCity : DSCity) {
-            dsCity.init(this, &DSLOpaque, {
-                {0, UNIFORM, sizeof(OpaqueUniformBlock), nullptr},
-                {1, TEXTURE, 0, &TCity}});
+        DSOpaque.init(this, &DSLOpaque, {
+                {0, UNIFORM_DYNAMIC, sizeof(OpaqueUniformBlock), nullptr, 2},
+                {1, TEXTURE, 0, &TCity}
+        });
+
+        DSCity.init(this, &DSLCity, {
+                {0, UNIFORM, sizeof(CityUniformBlock), nullptr}
+        });
+        cityDraws.init(this, static_cast<uint32_t>(MCity.size()));
+        emitInstances.init(this, static_cast<uint32_t>(ROAD_INSTANCES + STREET_INSTANCES));
+        setEmitInstances();
+        if (gpuCullingSupport) {
+            depthPyramid.init(this, "shaders/HiZDepthComp.spv", "shaders/HiZComp.spv");
+            gpuCulling.init(this, "shaders/CullComp.spv", depthPyramid, static_cast<uint32_t>(MCity.size() + 2),
+                            {static_cast<uint32_t>(MCity.size()), 1, 1});
         }
 
 		DSPlane.init(this, &DSLMetallic, {
@@ -401,10 +468,6 @@ class Game : public BaseProject {
                 {0, UNIFORM, sizeof(MetallicUniformBlock), nullptr},
                 {1, TEXTURE, 0,                            &TArrow}
         });
-        DSBox.init(this, &DSLOpaque, {
-                {0, UNIFORM, sizeof(OpaqueUniformBlock), nullptr},
-                {1, TEXTURE, 0, &TCity}
-        });
         DSRoad.init(this, &DSLEmit, {
                 {0, UNIFORM, sizeof(EmitUniformBlock), nullptr},
                 {1, TEXTURE, 0, &TCity},
@@ -416,69 +479,107 @@ class Game : public BaseProject {
                 {2, TEXTURE, 0, &TEmit}
         });
         DSGround.init(this, &DSLOpaque, {
-                {0, UNIFORM, sizeof(OpaqueUniformBlock), nullptr},
+                {0, UNIFORM_DYNAMIC, sizeof(OpaqueUniformBlock), nullptr},
                 {1, TEXTURE, 0, &TGround}
         });
-		DSScore.init(this, &DSLOverlay, {
-					{0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-					{1, TEXTURE, 0, &TScore}
-				});
-        DSLife.init(this, &DSLOverlay, {
-                {0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-                {1, TEXTURE, 0, &TLife}
-        });
-		DSSplash.init(this, &DSLOverlay, {
-					{0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-					{1, TEXTURE, 0, &TSplash}
+		DSOverlay.init(this, &DSLOverlay, {
+					{0, TEXTURE, 0, &overlayAtlas.texture}
 				});
-        DSWin.init(this, &DSLOverlay, {
-                {0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-                {1, TEXTURE, 0, &TWin}
-        });
-        DSLose.init(this, &DSLOverlay, {
-                {0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-                {1, TEXTURE, 0, &TLose}
-        });
-        DSHelp.init(this, &DSLOverlay, {
-                {0, UNIFORM, sizeof(OverlayUniformBlock), nullptr},
-                {1, TEXTURE, 0, &THelp}
-        });
+        overlayInstances.init(this, static_cast<uint32_t>(OVERLAY_INSTANCES));
         DSPropeller.init(this, &DSLPropeller, {
                 {0, UNIFORM, sizeof(AnimationUniformBlock), nullptr}
         });
 		DSGubo.init(this, &DSLGubo, {
 					{0, UNIFORM, sizeof(GlobalUniformBlock), nullptr}
 				});
+        mapMaterials();
+        if (gpuCullingSupport) {
+            setCullingObjects();
+        }
 	}
 
+    /**
+     * materials of metallic and opaque objects never change: their blocks are written once, when the sets are created
+     */
+    void mapMaterials() {
+        for (int i = 0; i < swapChainImages.size(); ++i) {
+            DSOpaque.mapDynamic(i, &uboCity, sizeof(uboCity), 0, CITY_OPAQUE_INDEX);
+            DSOpaque.mapDynamic(i, &uboBox, sizeof(uboBox), 0, BOX_OPAQUE_INDEX);
+            DSGround.mapDynamic(i, &uboGround, sizeof(uboGround), 0, 0);
+            DSPlane.map(i, &uboPlane, sizeof(uboPlane), 0);
+            DSArrow.map(i, &uboArrow, sizeof(uboArrow), 0);
+        }
+    }
+
+    /**
+     * road and street never move: the transforms of their instances are written once, when the buffers are created
+     */
+    void setEmitInstances() {
+        for (int i = 0; i < swapChainImages.size(); ++i) {
+            emitInstances.clear(i);
+            roadFirstInstance = emitInstances.counts[i];
+            for (const auto& instance : gridTransforms(ROAD_OFFSET, ROAD_ROWS, ROAD_INSTANCES)) {
+                emitInstances.add(i, instance);
+            }
+            streetFirstInstance = emitInstances.counts[i];
+            for (const auto& instance : gridTransforms(STREET_OFFSET, STREET_ROWS, STREET_INSTANCES)) {
+                emitInstances.add(i, instance);
+            }
+        }
+    }
+
+    /**
+     * city blocks, road and street never move: their world bounds are written once for the GPU culling, the blocks
+     * again at every frame with the range of their level of detail
+     */
+    void setCullingObjects() {
+        for (int i = 0; i < swapChainImages.size(); ++i) {
+            setCityCullingObjects(i);
+            uint32_t index = static_cast<uint32_t>(MCity.size());
+            gpuCulling.setObject(i, index++, GpuCulling::object(
+                    RRoad, roadBounds.transformed(uboRoad.mMat), ROAD_INSTANCES, roadFirstInstance, ROAD_DRAWS));
+            gpuCulling.setObject(i, index++, GpuCulling::object(
+                    RStreet, streetBounds.transformed(uboStreet.mMat), STREET_INSTANCES, streetFirstInstance,
+                    STREET_DRAWS));
+        }
+    }
+
+    void setCityCullingObjects(int currentImage) {
+        for (uint32_t block = 0; block < MCity.size(); ++block) {
+            gpuCulling.setObject(currentImage, block, GpuCulling::object(
+                    RCity[block][cityLods[block]], MCity[block].bounds.transformed(uboCityTransforms.blocks[block].mMat),
+                    1, block, CITY_DRAWS));
+        }
+    }
+
 	// Here you destroy your pipelines and Descriptor Sets!
 	// All the object classes defined in Starter.hpp have a method .cleanup() for this purpose
 	void pipelinesAndDescriptorSetsCleanup() {
 		// Cleanup pipelines
 		PMetallic.cleanup();
         POpaque.cleanup();
+        PCity.cleanup();
         PEmit.cleanup();
 		POverlay.cleanup();
         PPropeller.cleanup();
 
 		// Cleanup datasets
-        for (auto &dsCity : DSCity) {
-            dsCity.cleanup();
+        DSOpaque.cleanup();
+        DSCity.cleanup();
+        cityDraws.cleanup();
+        emitInstances.cleanup();
+        if (gpuCullingSupport) {
+            gpuCulling.cleanup();
+            depthPyramid.cleanup();
         }
-
 		DSPlane.cleanup();
-        DSBox.cleanup();
         DSRoad.cleanup();
         DSStreet.cleanup();
         DSArrow.cleanup();
         DSGround.cleanup();
-		DSScore.cleanup();
-        DSLife.cleanup();
-		DSSplash.cleanup();
-        DSWin.cleanup();
-        DSLose.cleanup();
+		DSOverlay.cleanup();
+        overlayInstances.cleanup();
 		DSGubo.cleanup();
-        DSHelp.cleanup();
         DSPropeller.cleanup();
 	}
 
@@ -491,36 +592,18 @@ class Game : public BaseProject {
 		TCity.cleanup();
         TArrow.cleanup();
         TGround.cleanup();
-		TScore.cleanup();
-        TLife.cleanup();
-		TSplash.cleanup();
-        TWin.cleanup();
-        TLose.cleanup();
-        THelp.cleanup();
+        overlayAtlas.cleanup();
         TEmit.cleanup();
 		
 		// Cleanup models
-        for (auto &mCity : MCity) {
-            mCity.cleanup();
-        }
-
-		MPlane.cleanup();
-        MBox.cleanup();
-        MRoad.cleanup();
-        MStreet.cleanup();
-        MArrow.cleanup();
-        MGround.cleanup();
-		MScore.cleanup();
-        MLife.cleanup();
-		MSplash.cleanup();
-        MWin.cleanup();
-        MLose.cleanup();
-        MHelp.cleanup();
+        GClassic.cleanup();
+		MOverlay.cleanup();
         MPropeller.cleanup();
 		
 		// Cleanup descriptor set layouts
 		DSLMetallic.cleanup();
         DSLOpaque.cleanup();
+        DSLCity.cleanup();
         DSLEmit.cleanup();
 		DSLOverlay.cleanup();
         DSLPropeller.cleanup();
@@ -530,6 +613,7 @@ class Game : public BaseProject {
 		// Destroys the pipelines
 		PMetallic.destroy();
         POpaque.destroy();
+        PCity.destroy();
         PEmit.destroy();
 		POverlay.destroy();
         PPropeller.destroy();
@@ -543,27 +627,69 @@ class Game : public BaseProject {
 	 * for each pipeline you have to gubo.bind(pipeline1), pipeline1.bind(), model1.bind(), ds1.bind(pipeline1), model2.bind(), ds2.bind(pipeline1)...
 	 * without mixing pipeline order (e.g. WRONG gubo.bind(pipeline1), gubo.bind(pipeline2), pipeline1.bind(), pipeline2.bind())
 	 */
+	/**
+	 * before the render pass: the city, road and street draws in view are written by the GPU culling
+	 */
+	void populateComputeCommands(VkCommandBuffer commandBuffer, int currentImage) {
+		if (!gpuCullingSupport) return;
+		gpuCulling.record(commandBuffer, currentImage, frustumPlanes, gubo.eyePos, CULLING_DISTANCE);
+		if (printCullingStatistics) {
+			const CullStatistics& statistics = gpuCulling.statistics;
+			cullingLogger.log<uint32_t>({{"Tested", statistics.tested},
+										 {"Frustum culled", statistics.frustumCulled},
+										 {"Occluded", statistics.occluded}},
+										[](uint32_t count) { return std::to_string(count); });
+		}
+	}
+
+	/**
+	 * after the render pass: the depth just drawn is reduced for the occlusion culling of the next frame
+	 */
+	void populatePostRenderCommands(VkCommandBuffer commandBuffer, int currentImage) {
+		if (!gpuCullingSupport) return;
+		depthPyramid.build(commandBuffer, viewProjection);
+	}
+
 	void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
 		// sets global uniforms (see below fro parameters explanation)
 		DSGubo.bind(commandBuffer, PMetallic, 0, currentImage);
 
         PMetallic.bind(commandBuffer);
 
-        MPlane.bind(commandBuffer);
+        // vertex and index buffers of all the VertexClassic models: stay bound when the pipeline changes
+        GClassic.bind(commandBuffer);
+
         DSPlane.bind(commandBuffer, PMetallic, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MPlane.indices.size()), 1, 0, 0, 0);
+        PMetallic.push(commandBuffer, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushPlane), &pushPlane);
+        GClassic.draw(commandBuffer, RPlane);
+
+        if (arrowVisible) {
+            DSArrow.bind(commandBuffer, PMetallic, 1, currentImage);
+            PMetallic.push(commandBuffer, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushArrow), &pushArrow);
+            GClassic.draw(commandBuffer, RArrow);
+        }
 
-        MArrow.bind(commandBuffer);
-        DSArrow.bind(commandBuffer, PMetallic, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MArrow.indices.size()), 1, 0, 0, 0);
+        if (uboPropeller.visible == 1.0f) {
+            PPropeller.bind(commandBuffer);
+            MPropeller.bind(commandBuffer);
+            DSPropeller.bind(commandBuffer, PPropeller, 0, currentImage);
+            vkCmdDrawIndexed(commandBuffer,
+                             static_cast<uint32_t>(MPropeller.indices.size()), PROPELLER_INSTANCES, 0, 0, 0);
+            GClassic.bind(commandBuffer); // the propeller has its own vertex format
+        }
+
+        // the visible city blocks: a single indirect draw, each block reads its transforms by instance index
+        DSGubo.bind(commandBuffer, PCity, 0, currentImage);
 
-        PPropeller.bind(commandBuffer);
-        MPropeller.bind(commandBuffer);
-        DSPropeller.bind(commandBuffer, PPropeller, 0, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MPropeller.indices.size()), PROPELLER_INSTANCES, 0, 0, 0);
+        PCity.bind(commandBuffer);
+
+        DSOpaque.bindDynamic(commandBuffer, PCity, 1, currentImage, CITY_OPAQUE_INDEX);
+        DSCity.bind(commandBuffer, PCity, 2, currentImage);
+        if (gpuCullingSupport) {
+            gpuCulling.draw(commandBuffer, currentImage, CITY_DRAWS);
+        } else {
+            cityDraws.draw(commandBuffer, currentImage);
+        }
 
         DSGubo.bind(commandBuffer, POpaque, 0, currentImage);
 
@@ -571,70 +697,171 @@ class Game : public BaseProject {
         POpaque.bind(commandBuffer);
 		// For a pipeline object, this command binds the corresponing pipeline to the command buffer passed in its parameter
 
-		// binds the model
-        for (int i = 0; i < MCity.size(); ++i) {
-            MCity[i].bind(commandBuffer);
-            DSCity[i].bind(commandBuffer, POpaque, 1, currentImage);
-            vkCmdDrawIndexed(commandBuffer,
-                             static_cast<uint32_t>(MCity[i].indices.size()), 1, 0, 0, 0);
+        if (boxVisible) {
+            DSOpaque.bindDynamic(commandBuffer, POpaque, 1, currentImage, BOX_OPAQUE_INDEX);
+            POpaque.push(commandBuffer, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushBox), &pushBox);
+            GClassic.draw(commandBuffer, RBox);
         }
 
-        MBox.bind(commandBuffer);
-        DSBox.bind(commandBuffer, POpaque, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MBox.indices.size()), 1, 0, 0, 0);
-
-        MGround.bind(commandBuffer);
-        DSGround.bind(commandBuffer, POpaque, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MGround.indices.size()), 1, 0, 0, 0);
+        DSGround.bindDynamic(commandBuffer, POpaque, 1, currentImage, 0);
+        POpaque.push(commandBuffer, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushGround), &pushGround);
+        GClassic.draw(commandBuffer, RGround);
 
         DSGubo.bind(commandBuffer, PEmit, 0, currentImage);
 
         PEmit.bind(commandBuffer);
+        emitInstances.bind(commandBuffer, currentImage, 1);
+
+        // road and street have different descriptor sets: each has its own list in the GPU culling
+        if (gpuCullingSupport) {
+            DSRoad.bind(commandBuffer, PEmit, 1, currentImage);
+            gpuCulling.draw(commandBuffer, currentImage, ROAD_DRAWS);
+            DSStreet.bind(commandBuffer, PEmit, 1, currentImage);
+            gpuCulling.draw(commandBuffer, currentImage, STREET_DRAWS);
+        } else {
+            if (roadVisible) {
+                DSRoad.bind(commandBuffer, PEmit, 1, currentImage);
+                GClassic.draw(commandBuffer, RRoad, ROAD_INSTANCES, roadFirstInstance);
+            }
 
-        MRoad.bind(commandBuffer);
-        DSRoad.bind(commandBuffer, PEmit, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MRoad.indices.size()), ROAD_INSTANCES, 0, 0, 0);
+            if (streetVisible) {
+                DSStreet.bind(commandBuffer, PEmit, 1, currentImage);
+                GClassic.draw(commandBuffer, RStreet, STREET_INSTANCES, streetFirstInstance);
+            }
+        }
+
+        drawOverlays(commandBuffer, currentImage);
+	}
 
-        MStreet.bind(commandBuffer);
-        DSStreet.bind(commandBuffer, PEmit, 1, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MStreet.indices.size()), STREET_INSTANCES, 0, 0, 0);
+    /**
+     * the command buffer is recorded at every frame, after the uniforms are updated: the visible overlays are written
+     * as instances of MOverlay, one per element they show (e.g. one per remaining life), and drawn by a single call.
+     * Instances are drawn in order, so the later overlays are still over the earlier ones
+     */
+    void drawOverlays(VkCommandBuffer commandBuffer, int currentImage) {
+        overlayInstances.clear(currentImage);
+        for (const auto& overlay : overlays) {
+            if (!overlay.visible) continue;
+            for (int i = 0; i < overlay.instancesToDraw; ++i) {
+                glm::vec2 offset = overlay.offset * static_cast<float>(i);
+                overlayInstances.add(currentImage, {overlay.rect + glm::vec4(offset, offset),
+                                                    overlayAtlas.region(overlay.atlasImage)});
+            }
+        }
+        if (overlayInstances.counts[currentImage] == 0) return;
 
 		POverlay.bind(commandBuffer);
-		MScore.bind(commandBuffer);
-		DSScore.bind(commandBuffer, POverlay, 0, currentImage);
-		vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MScore.indices.size()), WINNING_SCORE, 0, 0, 0);
-        DSLife.bind(commandBuffer, POverlay, 0, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MLife.indices.size()), STARTING_LIVES, 0, 0, 0);
-		MSplash.bind(commandBuffer);
-		DSSplash.bind(commandBuffer, POverlay, 0, currentImage);
-		vkCmdDrawIndexed(commandBuffer,
-				static_cast<uint32_t>(MSplash.indices.size()), 1, 0, 0, 0);
-        MWin.bind(commandBuffer);
-        DSWin.bind(commandBuffer, POverlay, 0, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MWin.indices.size()), 1, 0, 0, 0);
-        MLose.bind(commandBuffer);
-        DSLose.bind(commandBuffer, POverlay, 0, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MLose.indices.size()), 1, 0, 0, 0);
-        MHelp.bind(commandBuffer);
-        DSHelp.bind(commandBuffer, POverlay, 0, currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(MHelp.indices.size()), 1, 0, 0, 0);
-	}
+        MOverlay.bind(commandBuffer);
+        overlayInstances.bind(commandBuffer, currentImage, 1);
+        DSOverlay.bind(commandBuffer, POverlay, 0, currentImage);
+        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MOverlay.indices.size()),
+                         overlayInstances.counts[currentImage], 0, 0, 0);
+    }
+
+    /**
+     * runs the loaders on a pool with a thread per core and waits for all of them, rethrowing the first error: prints
+     * the messages of each loader, in order, and how long they took together and the sum of their times, i.e. loading
+     * them one after the other
+     */
+    static void runLoaders(const std::vector<std::function<void()>>& loaders) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<double> durations(loaders.size(), 0);
+        std::vector<std::ostringstream> messages(loaders.size());
+        ThreadPool pool;
+        std::vector<std::future<void>> loaded;
+        for (size_t i = 0; i < loaders.size(); ++i) {
+            loaded.push_back(pool.submit([&loaders, &durations, &messages, i] {
+                TaskLog log(messages[i]);
+                auto loaderStart = std::chrono::steady_clock::now();
+                loaders[i]();
+                durations[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                         loaderStart).count();
+            }));
+        }
+        for (size_t i = 0; i < loaded.size(); ++i) {
+            loaded[i].wait();
+            std::cout << messages[i].str();
+        }
+        for (auto& loader : loaded) loader.get();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double sequential = std::accumulate(durations.begin(), durations.end(), 0.0);
+        std::cout << "Loaded " << loaders.size() << " assets on " << pool.size() << " threads in " << elapsed
+                  << " ms instead of " << sequential << " ms, speed-up " << sequential / elapsed << "x\n";
+    }
+
+    /**
+     * transforms of the instances of a tile repeated on a grid: instance i is moved by (i % rows) * offset.x along x
+     * and (i / rows) * offset.z along z, in model coordinates
+     */
+    static std::vector<InstanceTransform> gridTransforms(const vec3& offset, int rows, int instances) {
+        std::vector<InstanceTransform> transforms(instances);
+        for (int i = 0; i < instances; ++i) {
+            transforms[i].mMat = translate(mat4(1), vec3(static_cast<float>(i % rows) * offset.x, 0,
+                                                         static_cast<float>(i / rows) * offset.z));
+        }
+        return transforms;
+    }
+
+    /**
+     * bounds of all the instances of a model, in model coordinates
+     */
+    static BoundingVolume computeInstancesBounds(const BoundingVolume& model,
+                                                 const std::vector<InstanceTransform>& instances) {
+        BoundingVolume bounds;
+        for (const auto& instance : instances) {
+            bounds.merge(model.transformed(instance.mMat));
+        }
+        return bounds;
+    }
+
+    /**
+     * tests the bounds of the city blocks, box, arrow, road and street against the view frustum: the draws of what is
+     * outside are not recorded. The plane and the ground are always in view, as the camera follows the plane.
+     * The city blocks in view are written in the indirect draws of the frame, with their index as first instance.
+     * With GPU culling only the box and the arrow are tested here, the planes are kept for the compute pass
+     */
+    void cullAgainstFrustum(uint32_t currentImage, const glm::mat4& viewProjection, const glm::mat4& arrowWorld,
+                            const glm::mat4& boxWorld) {
+        Frustum frustum(viewProjection);
+        arrowVisible = frustum.isVisible(MArrow.bounds, arrowWorld);
+        boxVisible = frustum.isVisible(MBox.bounds, boxWorld);
+        if (gpuCullingSupport) {
+            frustumPlanes = frustum.getPlanes();
+            setCityCullingObjects(static_cast<int>(currentImage));
+            return;
+        }
+        cityDraws.clear(currentImage);
+        for (int i = 0; i < MCity.size(); ++i) {
+            if (frustum.isVisible(MCity[i].bounds, uboCityTransforms.blocks[i].mMat)) {
+                cityDraws.add(currentImage, RCity[i][cityLods[i]], 1, i);
+            }
+        }
+        roadVisible = frustum.isVisible(roadBounds, uboRoad.mMat);
+        streetVisible = frustum.isVisible(streetBounds, uboStreet.mMat);
+    }
+
+    /**
+     * chooses the level of detail of each city block from the size of its bounding sphere on the screen
+     * @param FOVy vertical field of view of the camera
+     */
+    void selectCityLods(const glm::vec3& camPos, float FOVy) {
+        for (int i = 0; i < MCity.size(); ++i) {
+            BoundingVolume bounds = MCity[i].bounds.transformed(uboCityTransforms.blocks[i].mMat);
+            float distance = glm::length(bounds.center - camPos);
+            float screenSize = distance > bounds.radius ? bounds.radius / (distance * std::tan(FOVy * 0.5f))
+                                                        : std::numeric_limits<float>::max(); // camera inside
+            cityLods[i] = selectLevelOfDetail(cityLods[i], screenSize, LOD_SCREEN_SIZES, LOD_HYSTERESIS);
+        }
+    }
 
     void updateSplashUniformBuffer(uint32_t currentImage, UserInputs& userInputs) {
-        uboSplash.visible = (gameState == SPLASH) ? 1.0f : 0.0f;
-        DSSplash.map(currentImage, &uboSplash, sizeof(uboSplash), 0);
+        overlays[OVERLAY_SPLASH].visible = logic.getGameState() == SPLASH;
     }
 
-    void updatePlayingUniformBuffer(uint32_t currentImage, UserInputs& userInputs) {
+    /**
+     * @param alpha how far the frame is between the last two physics steps
+     */
+    void updatePlayingUniformBuffer(uint32_t currentImage, UserInputs& userInputs, float alpha) {
         /**
          * keep gubo.eyePos fixed
          * compute the position of the plane, i.e. the plane's world matrix + view and projection matrices based on plane position (world matrix)
@@ -653,13 +880,13 @@ class Game : public BaseProject {
          * but you can find the vertex "terrain" with closest xz and enforce that player.y > terrain.y
          */
 
-        if(plane.isCollisionDetected() && gameState == PLAYING) {
-            lives--;
-        }
+        const GameState gameState = logic.getGameState();
+        Plane& plane = logic.getPlane();
+        const glm::vec3& targetPos = logic.getTargetPosition();
 
-        glm::mat4 planeWorldMat = plane.computeWorldMatrix();
+        glm::mat4 planeWorldMat = plane.computeWorldMatrix(alpha);
         glm::vec3 camPos = computeCameraPosition(planeWorldMat, userInputs);
-        glm::vec3 planePos = plane.getPositionInWorldCoordinates();
+        glm::vec3 planePos = glm::vec3(planeWorldMat[3]);
         glm::mat4 viewMat = glm::lookAt(camPos, planePos, glm::vec3(0.0f, 1.0f, 0.0f)) ;
         glm::mat4 projMat = glm::perspective(FOVy, Ar, nearPlane, farPlane);
         projMat[1][1] *= -1;
@@ -678,31 +905,24 @@ class Game : public BaseProject {
          * has its own Model View Projection matrix (mvpMat), as you see below, and they all move using the World matrix
          */
 
+        // metallic and opaque objects: only the transforms change, in the city uniform block or pushed with the draws
         for (int i = 0; i < MCity.size(); ++i) {
-            uboCity[i].mvpMat = projMat * viewMat * uboCity[i].mMat;
-            DSCity[i].map(currentImage, &uboCity[i], sizeof(uboCity[i]), 0);
+            uboCityTransforms.blocks[i].mvpMat = projMat * viewMat * uboCityTransforms.blocks[i].mMat;
         }
+        DSCity.map(currentImage, &uboCityTransforms, sizeof(uboCityTransforms), 0);
 
-        uboPlane.mvpMat = projMat * viewMat * planeWorldMat;
-        uboPlane.mMat = planeWorldMat; // plane world mat changes at each frame
-        uboPlane.nMat = glm::inverse(glm::transpose(planeWorldMat));
-        DSPlane.map(currentImage, &uboPlane, sizeof(uboPlane), 0);
+        pushPlane.mMat = planeWorldMat; // plane world mat changes at each frame
+        pushPlane.mvpMat = projMat * viewMat * planeWorldMat;
 
-        if (box.isTargetHit() && gameState == PLAYING) {
-            targetPos.x = static_cast<float>(rand() % RANGE + START);
-            targetPos.z = static_cast<float>(rand() % RANGE + START);
-            if (gameState == 1) score++;
-        }
+        pushArrow.mMat = glm::translate(glm::mat4(1), glm::vec3(targetPos.x, -2, targetPos.z));
+        pushArrow.mvpMat = projMat * viewMat * pushArrow.mMat;
 
-        uboArrow.mMat = glm::translate(glm::mat4(1), glm::vec3(targetPos.x, -2, targetPos.z));
-        uboArrow.mvpMat = projMat * viewMat * uboArrow.mMat;
-        uboArrow.nMat = glm::inverse(glm::transpose(uboArrow.mMat));
-        DSArrow.map(currentImage, &uboArrow, sizeof(uboArrow), 0);
+        pushBox.mMat = logic.getPackage().computeWorldMatrix(alpha);
+        pushBox.mvpMat = projMat * viewMat * pushBox.mMat;
 
-        uboBox.mMat = box.computeWorldMatrix();
-        uboBox.mvpMat = projMat * viewMat * uboBox.mMat;
-        uboBox.nMat = glm::inverse(glm::transpose(uboBox.mMat));
-        DSBox.map(currentImage, &uboBox, sizeof(uboBox), 0);
+        viewProjection = projMat * viewMat;
+        selectCityLods(camPos, FOVy);
+        cullAgainstFrustum(currentImage, viewProjection, pushArrow.mMat, pushBox.mMat);
 
         uboRoad.mvpMat = projMat * viewMat * uboRoad.mMat;
         DSRoad.map(currentImage, &uboRoad, sizeof(uboRoad), 0);
@@ -710,19 +930,15 @@ class Game : public BaseProject {
         uboStreet.mvpMat = projMat * viewMat * uboStreet.mMat;
         DSStreet.map(currentImage, &uboStreet, sizeof(uboStreet), 0);
 
-        uboGround.mvpMat = projMat * viewMat * uboGround.mMat;
-        DSGround.map(currentImage, &uboGround, sizeof(uboGround), 0);
+        pushGround.mvpMat = projMat * viewMat * pushGround.mMat;
 
-        uboScore.visible = (gameState == 1) ? 1.0f : 0.0f;
-        uboScore.instancesToDraw = static_cast<float>(WINNING_SCORE - score);
-        DSScore.map(currentImage, &uboScore, sizeof(uboScore), 0);
+        overlays[OVERLAY_SCORE].visible = gameState == 1;
+        overlays[OVERLAY_SCORE].instancesToDraw = GameLogic::WINNING_SCORE - logic.getScore();
 
-        uboLife.visible = (gameState == 1) ? 1.0f : 0.0f;
-        uboLife.instancesToDraw = static_cast<float>(lives);
-        DSLife.map(currentImage, &uboLife, sizeof(uboLife), 0);
+        overlays[OVERLAY_LIFE].visible = gameState == 1;
+        overlays[OVERLAY_LIFE].instancesToDraw = logic.getLives();
 
-        uboHelp.visible = (gameState == 1) ? 1.0f : 0.0f;
-        DSHelp.map(currentImage, &uboHelp, sizeof(uboHelp), 0);
+        overlays[OVERLAY_HELP].visible = gameState == 1;
 
         //cout << "plane x speed: " << plane->getSpeedInPlaneCoordinates().x << "\n";
         uboPropeller.mvpMat = projMat * viewMat * translate(scale(planeWorldMat, vec3(0.2)), {- PROPELLER_OFFSET.x / 2.0, 5.0, 7.0});
@@ -732,13 +948,11 @@ class Game : public BaseProject {
     }
 
     void updateWinUniformBuffer(uint32_t currentImage, UserInputs& userInputs) {
-        uboWin.visible = (gameState == WON) ? 1.0f : 0.0f;
-        DSWin.map(currentImage, &uboWin, sizeof(uboWin), 0);
+        overlays[OVERLAY_WIN].visible = logic.getGameState() == WON;
     }
 
     void updateLoseUniformBuffer(uint32_t currentImage, UserInputs& userInputs) {
-        uboLose.visible = (gameState == LOST) ? 1.0f : 0.0f;
-        DSLose.map(currentImage, &uboLose, sizeof(uboLose), 0);
+        overlays[OVERLAY_LOSE].visible = logic.getGameState() == LOST;
     }
 
 	// Here is where you update the uniforms.
@@ -749,37 +963,21 @@ class Game : public BaseProject {
 			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
 
-        auto userInputs = UserInputs(this, gameState);
-        plane.updateInputs(&userInputs);
-        box.updateInputs(&userInputs);
-
-		switch(gameState) {
-		  case SPLASH: {
-              plane.resetState();
-              if(userInputs.handleNext) gameState = PLAYING;
-              break;
-          }
-		  case PLAYING: {
-              if (lives <= 0) {
-                  gameState = LOST;
-                  break;
-              }
-              if (score >= WINNING_SCORE) gameState = WON;
-              break;
-          }
-          case WON:
-          case LOST:
-          {
-              score = 0;
-              lives = STARTING_LIVES;
-              plane.resetState();
-              if(userInputs.handleNext) gameState = SPLASH;
-              break;
-          }
-		}
+        FrameInputs frame;
+        if (player.isOpen()) {
+            if (!player.next(frame)) { // the recorded session is over
+                glfwSetWindowShouldClose(window, GL_TRUE);
+                return;
+            }
+        } else {
+            getSixAxis(frame.deltaT, frame.m, frame.r, frame.fire);
+        }
+        if (recorder.isOpen()) recorder.record(frame);
+        auto userInputs = UserInputs(frame.deltaT, frame.m, frame.r, frame.fire, logic.getGameState());
+        float alpha = logic.update(userInputs);
 
         updateSplashUniformBuffer(currentImage, userInputs);
-        updatePlayingUniformBuffer(currentImage, userInputs);
+        updatePlayingUniformBuffer(currentImage, userInputs, alpha);
         updateWinUniformBuffer(currentImage, userInputs);
         updateLoseUniformBuffer(currentImage, userInputs);
 	}
@@ -797,7 +995,7 @@ class Game : public BaseProject {
         const float camPitch = 0.5;
 
         static auto posDamper = Damper<vec3>(10);
-        if (userInputs.handleR) return posDamper.damp({PLANE_STARTING_POS.x, 3, PLANE_STARTING_POS.z}, userInputs.deltaT);
+        if (userInputs.handleR) return posDamper.damp({GameLogic::PLANE_STARTING_POS.x, 3, GameLogic::PLANE_STARTING_POS.z}, userInputs.deltaT);
 
         vec3 posNew =
                 world
@@ -810,13 +1008,52 @@ class Game : public BaseProject {
 
         return posDamper.damp(posNew, userInputs.deltaT);
     }
+
+public:
+    /**
+     * @param record if not empty, the inputs of the session are recorded to this file
+     * @param replay if not empty, the session recorded in this file is played instead of reading the inputs
+     */
+    void setInputRecording(const std::string& record, const std::string& replay) {
+        recordPath = record;
+        replayPath = replay;
+    }
+
+    void setPrintCullingStatistics(bool print) {
+        printCullingStatistics = print;
+    }
+
+    void setUploadsOnGraphicsQueue(bool graphicsQueue) {
+        uploadsOnGraphicsQueue = graphicsQueue;
+    }
 };
 
 
-// This is the main: probably you do not need to touch this!
-int main() {
+// This is the main: --record and --replay save and play back the inputs of a session,
+// --culling-statistics prints what the GPU culling skips, --graphics-queue-uploads keeps the uploads on the
+// graphics queue to run the path of the devices without a transfer queue family
+int main(int argc, char* argv[]) {
     Game app;
 
+    std::string record, replay;
+    bool cullingStatistics = false;
+    bool graphicsQueueUploads = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay = argv[++i];
+        else if (arg == "--culling-statistics") cullingStatistics = true;
+        else if (arg == "--graphics-queue-uploads") graphicsQueueUploads = true;
+        else {
+            std::cerr << "usage: " << argv[0] << " [--record file] [--replay file] [--culling-statistics]"
+                         " [--graphics-queue-uploads]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    app.setInputRecording(record, replay);
+    app.setPrintCullingStatistics(cullingStatistics);
+    app.setUploadsOnGraphicsQueue(graphicsQueueUploads);
+
     try {
         app.run();
     } catch (const std::exception& e) {
@@ -0,0 +1,170 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_GAMELOGIC_HPP
+#define DRONE_DELIVERY_GAMELOGIC_HPP
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include "UserInputs.hpp"
+#include "Plane.hpp"
+#include "Package.hpp"
+#include "Wing.hpp"
+#include "HeightRaster.hpp"
+#include "FixedTimestep.hpp"
+
+/**
+ * Everything that happens in a game, without rendering: state machine, physics, collisions, package drops, score and
+ * lives. Doesn't depend on Vulkan or GLFW, so it can also be run by the headless target.
+ */
+class GameLogic {
+public:
+    constexpr static const int WINNING_SCORE = 5;
+    constexpr static const int STARTING_LIVES = 3;
+    constexpr static const unsigned int DEFAULT_SEED = 1; // the seed rand() starts from when srand() isn't called
+    constexpr static const vec3 PLANE_STARTING_POS = {48, 0, 0}; // starts in middle of long side offset to the side
+
+    // city blocks parameters
+    constexpr static const int CITY_BLOCKS = 12;
+    constexpr static const vec3 CITY_STARTING_POS = {-36, 0, -48}; // centers city in the square 120x120 map
+    constexpr static const int CITY_OFFSET = 24; // distance between buildings
+    constexpr static const int CITY_DIM = 3; // in our case 3x4 city so every 3 blocks jump to next row
+    constexpr static const float CITY_RASTER_RESOLUTION = 4; // texels per world unit of the collision raster
+
+private:
+    // moving target random range: values that make it land inside ground
+    constexpr static const int RANGE = 120; // target random position xz range
+    constexpr static const int START = -60; // starting value
+
+    const std::string CITY_RASTER_FILE = "models/city.heightraster";
+
+    GameState gameState = SPLASH;
+    glm::vec3 targetPos{0};
+    HeightRaster cityRaster; // collision world of the city blocks, baked (or loaded) by init
+
+    LogarithmicWing wingImplementation = LogarithmicWing(Plane::MAX_WING_LIFT, Plane::MAX_SPEED, Plane::BASE);
+    Plane plane = Plane(wingImplementation, cityRaster, PLANE_STARTING_POS);
+    Package box = Package(plane.getPositionInWorldCoordinates(), plane.getSpeedInWorldCoordinates(), targetPos);
+    int score = 0;
+    int lives = STARTING_LIVES;
+
+    FixedTimestep physicsClock; // plane and package are simulated at a fixed rate, independent of the frame rate
+    bool pendingFire = false; // fire released in a frame that ran no physics step: handled by the next step
+
+    void moveTarget() {
+        targetPos.x = static_cast<float>(rand() % RANGE + START);
+        targetPos.z = static_cast<float>(rand() % RANGE + START);
+    }
+
+    /**
+     * runs the physics steps covering the time elapsed since the previous frame, and the game events they cause
+     * @return how far the frame is between the last two physics steps, to interpolate the rendered objects
+     */
+    float stepPhysics(UserInputs& userInputs) {
+        pendingFire = pendingFire || userInputs.handleFire;
+        int steps = physicsClock.advance(userInputs.deltaT);
+        for (int i = 0; i < steps; ++i) {
+            userInputs.handleFire = pendingFire; // a fire release drops a single package, in the first step
+            pendingFire = false;
+            plane.step(physicsClock.getStep());
+            box.step(physicsClock.getStep());
+
+            // events are checked at every step: a collision or a hit can't be lost in a frame with many steps
+            if (plane.isCollisionDetected() && gameState == PLAYING) {
+                lives--;
+            }
+            if (box.isTargetHit() && gameState == PLAYING) {
+                moveTarget();
+                score++;
+            }
+        }
+        return physicsClock.getAlpha();
+    }
+
+public:
+    /**
+     * computes the translation vector for a given model among the city models
+     * @param index of the model for which to compute the translation
+     */
+    static vec3 computeCityTranslation(int index) {
+        return CITY_STARTING_POS + vec3{(index % CITY_DIM) * CITY_OFFSET, 0, (index / CITY_DIM) * CITY_OFFSET};
+    }
+
+    /**
+     * starts from the splash screen and prepares the collision world
+     * @param cityTriangles triangles of all the city blocks, already placed with computeCityTranslation
+     * @param seed of rand(), which places the targets: the same seed and inputs give the same game
+     */
+    void init(const std::vector<Triangle>& cityTriangles, unsigned int seed) {
+        srand(seed);
+        gameState = SPLASH;
+        moveTarget();
+        targetPos.y = 0;
+        cityRaster.loadOrBake(cityTriangles, CITY_RASTER_RESOLUTION, Plane::COLLISION_DISTANCE, CITY_RASTER_FILE);
+    }
+
+    /**
+     * advances the game by a frame
+     * @return how far the frame is between the last two physics steps, to interpolate the rendered objects
+     */
+    float update(UserInputs& userInputs) {
+        plane.updateInputs(&userInputs);
+        box.updateInputs(&userInputs);
+
+        switch(gameState) {
+            case SPLASH: {
+                plane.resetState();
+                if(userInputs.handleNext) gameState = PLAYING;
+                break;
+            }
+            case PLAYING: {
+                if (lives <= 0) {
+                    gameState = LOST;
+                    break;
+                }
+                if (score >= WINNING_SCORE) gameState = WON;
+                break;
+            }
+            case WON:
+            case LOST:
+            {
+                score = 0;
+                lives = STARTING_LIVES;
+                plane.resetState();
+                if(userInputs.handleNext) gameState = SPLASH;
+                break;
+            }
+        }
+
+        return stepPhysics(userInputs);
+    }
+
+    GameState& getGameState() {
+        return gameState;
+    }
+
+    int getScore() const {
+        return score;
+    }
+
+    int getLives() const {
+        return lives;
+    }
+
+    const glm::vec3& getTargetPosition() const {
+        return targetPos;
+    }
+
+    Plane& getPlane() {
+        return plane;
+    }
+
+    const Package& getPackage() const {
+        return box;
+    }
+};
+
+#endif //DRONE_DELIVERY_GAMELOGIC_HPP
@@ -0,0 +1,258 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+// Runs the game without a window or a GPU: the city models are decoded only for their geometry, and the inputs of
+// each frame come from a script instead of the keyboard. Simulates as fast as the CPU allows, to test and profile the
+// game logic and physics.
+// usage: drone-delivery-headless [--script file] [--seconds N] [--dt frameTime] [--record file] [--replay file] [--self-check]
+// script lines: duration m.x m.y m.z r.x r.y r.z fire   ('#' starts a comment, the script loops until N seconds)
+// a replay (recorded here or by the game) is played to its end instead of the script
+// --self-check only runs the consistency checks of the collision world and of the levels of detail, and exits
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <random>
+#include "GLTFDecoder.hpp"
+#include "DataStructs.hpp"
+#include "GameLogic.hpp"
+#include "InputRecording.hpp"
+#include "TriangleBVH.hpp"
+#include "LevelOfDetail.hpp"
+
+/**
+ * inputs held for a time
+ */
+struct ScriptLine {
+    float duration;
+    glm::vec3 m;
+    glm::vec3 r;
+    bool fire;
+};
+
+/**
+ * built-in script: leaves the splash screen, then flies around the city dropping packages
+ */
+std::vector<ScriptLine> defaultScript() {
+    return {
+            {0.1f, {0, 0, 0}, {0, 0, 0}, true},   // fire pressed and released: splash -> playing
+            {0.1f, {0, 0, 0}, {0, 0, 0}, false},
+            {2.0f, {0, 1, 1}, {0, 0, 0}, false},  // climb while accelerating
+            {3.0f, {0, 0, 1}, {0, 1, 0}, false},  // turn
+            {0.1f, {0, 0, 1}, {0, 0, 0}, true},   // drop a package
+            {0.1f, {0, 0, 1}, {0, 0, 0}, false},
+            {3.0f, {0, 0, 1}, {0, -1, 0}, false}, // turn back
+            {2.0f, {0, -1, 0}, {0, 0, 0}, false}, // descend
+    };
+}
+
+std::vector<ScriptLine> loadScript(const std::string& file) {
+    std::ifstream stream(file);
+    if (!stream.is_open()) {
+        throw std::runtime_error("failed to open script " + file);
+    }
+    std::vector<ScriptLine> script;
+    std::string line;
+    while (std::getline(stream, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream values(line);
+        ScriptLine scriptLine{};
+        int fire;
+        if (values >> scriptLine.duration >> scriptLine.m.x >> scriptLine.m.y >> scriptLine.m.z
+                   >> scriptLine.r.x >> scriptLine.r.y >> scriptLine.r.z >> fire) {
+            scriptLine.fire = fire != 0;
+            script.push_back(scriptLine);
+        }
+    }
+    if (script.empty()) {
+        throw std::runtime_error("script " + file + " has no inputs");
+    }
+    return script;
+}
+
+std::vector<Triangle> loadCityTriangles() {
+    std::vector<Triangle> cityTriangles;
+    for (int i = 0; i < GameLogic::CITY_BLOCKS; ++i) {
+        std::vector<VertexClassic> vertices;
+        std::vector<uint32_t> indices;
+        loadGLTFPositions("models/city_" + std::to_string(i) + ".mgcg", true, vertices, indices);
+        appendTriangles(cityTriangles, vertices, indices, GameLogic::computeCityTranslation(i));
+    }
+    return cityTriangles;
+}
+
+/**
+ * checks that the height raster the game collides with is conservative, against the exact triangle world of the BVH:
+ * a point inside a building, or a sphere touching a face above its center, always has to collide with the raster
+ * @return number of failed samples
+ */
+int checkRasterAgainstBVH(const std::vector<Triangle>& cityTriangles, int samples) {
+    const float radius = Plane::COLLISION_DISTANCE;
+    HeightRaster raster;
+    raster.bake(cityTriangles, GameLogic::CITY_RASTER_RESOLUTION, radius);
+    TriangleBVH bvh;
+    bvh.addTriangles(cityTriangles);
+    bvh.build();
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> footprint(-60, 60);
+    std::uniform_real_distribution<float> height(0, 30);
+    int failures = 0, inside = 0, touching = 0, rasterOnly = 0;
+    for (int i = 0; i < samples; ++i) {
+        glm::vec3 p{footprint(generator), height(generator), footprint(generator)};
+        bool rasterHit = raster.collidesWith(p, radius);
+        glm::vec3 closest{0};
+        bool faceAbove = bvh.closestPoint(p, closest) <= radius && closest.y > p.y &&
+                         glm::length(glm::vec2(closest.x - p.x, closest.z - p.z)) < radius;
+        bool volume = bvh.pointInVolume(p);
+        inside += volume;
+        touching += faceAbove;
+        if ((volume || faceAbove) && !rasterHit) failures++;
+        if (rasterHit && !bvh.collidesWith(p, radius)) rasterOnly++;
+    }
+    std::cout << "raster against BVH: " << samples << " samples, " << inside << " inside the buildings, " << touching
+              << " touching a face above, " << rasterOnly << " only colliding with the raster, " << failures
+              << " missed by the raster\n";
+    return failures;
+}
+
+/**
+ * simplifies each city block to levels of half the triangles of the one before, without an error limit: every level
+ * has to reach its target, without degenerate triangles or triangles facing the other way than in the block
+ * @return number of failed levels
+ */
+int checkLevelsOfDetail(int levels) {
+    int failures = 0;
+    for (int i = 0; i < GameLogic::CITY_BLOCKS; ++i) {
+        std::vector<VertexClassic> vertices;
+        std::vector<uint32_t> indices;
+        loadGLTFPositions("models/city_" + std::to_string(i) + ".mgcg", true, vertices, indices);
+        MeshSimplifier simplifier(vertices, indices);
+        size_t previous = indices.size() / 3;
+        std::cout << "levels of detail of block " << i << ": " << previous;
+        for (int level = 1; level < levels; ++level) {
+            size_t target = previous / 2;
+            simplifier.simplify(target, std::numeric_limits<float>::infinity());
+            std::vector<uint32_t> triangles = simplifier.getTriangles();
+            std::vector<uint32_t> levelIndices = simplifier.getIndices();
+            int degenerate = 0, flipped = 0;
+            for (size_t t = 0; t < triangles.size(); ++t) {
+                glm::vec3 a = vertices[levelIndices[3 * t]].pos;
+                glm::vec3 b = vertices[levelIndices[3 * t + 1]].pos;
+                glm::vec3 c = vertices[levelIndices[3 * t + 2]].pos;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                const uint32_t* original = &indices[3 * triangles[t]];
+                glm::vec3 originalNormal = glm::cross(vertices[original[1]].pos - vertices[original[0]].pos,
+                                                      vertices[original[2]].pos - vertices[original[0]].pos);
+                if (normal == glm::vec3(0)) degenerate++;
+                else if (glm::dot(normal, originalNormal) < 0) flipped++;
+            }
+            std::cout << " -> " << triangles.size() << " (target " << target << ", " << degenerate << " degenerate, "
+                      << flipped << " flipped)";
+            if (triangles.size() > target || degenerate > 0 || flipped > 0) failures++;
+            previous = triangles.size();
+        }
+        std::cout << "\n";
+    }
+    return failures;
+}
+
+const char* stateName(GameState state) {
+    switch (state) {
+        case SPLASH: return "SPLASH";
+        case PLAYING: return "PLAYING";
+        case WON: return "WON";
+        case LOST: return "LOST";
+    }
+    return "?";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<ScriptLine> script = defaultScript();
+    float seconds = 60;
+    float frameTime = 1.0f / 60.0f;
+    std::string record, replay;
+    bool selfCheck = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--script" && i + 1 < argc) script = loadScript(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) seconds = std::stof(argv[++i]);
+        else if (arg == "--dt" && i + 1 < argc) frameTime = std::stof(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc) record = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay = argv[++i];
+        else if (arg == "--self-check") selfCheck = true;
+        else {
+            std::cerr << "usage: " << argv[0] << " [--script file] [--seconds N] [--dt frameTime] [--record file] [--replay file] [--self-check]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        if (selfCheck) {
+            int failures = checkRasterAgainstBVH(loadCityTriangles(), 50000) + checkLevelsOfDetail(4);
+            return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        auto loadStart = std::chrono::steady_clock::now();
+        InputPlayer player;
+        InputRecorder recorder;
+        unsigned int seed = GameLogic::DEFAULT_SEED;
+        if (!replay.empty()) {
+            player.open(replay);
+            seed = player.getSeed();
+        }
+        if (!record.empty()) recorder.open(record, seed);
+        GameLogic logic;
+        logic.init(loadCityTriangles(), seed);
+        auto start = std::chrono::steady_clock::now();
+
+        size_t line = 0;
+        float lineTime = 0;
+        float simulated = 0;
+        long frames = 0;
+        FrameInputs frame;
+        while (player.isOpen() ? player.next(frame) : simulated < seconds) {
+            if (!player.isOpen()) {
+                const ScriptLine& inputs = script[line];
+                frame = {frameTime, inputs.m, inputs.r, inputs.fire};
+                lineTime += frameTime;
+                if (lineTime >= inputs.duration) {
+                    lineTime = 0;
+                    line = (line + 1) % script.size();
+                }
+            }
+            if (recorder.isOpen()) recorder.record(frame);
+            auto userInputs = UserInputs(frame.deltaT, frame.m, frame.r, frame.fire, logic.getGameState());
+            logic.update(userInputs);
+
+            simulated += frame.deltaT;
+            frames++;
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        double load = std::chrono::duration<double>(start - loadStart).count();
+        double wall = std::chrono::duration<double>(end - start).count();
+        glm::vec3 position = logic.getPlane().getPositionInWorldCoordinates();
+        std::cout << "state: " << stateName(logic.getGameState()) << ", score: " << logic.getScore()
+                  << ", lives: " << logic.getLives() << "\n";
+        // printed exactly, to compare replays of the same session
+        std::cout << std::setprecision(9) << "plane position: " << position.x << " " << position.y << " " << position.z << "\n";
+        std::cout << std::setprecision(6) << "loaded city in " << load << " s\n";
+        std::cout << "simulated " << simulated << " s (" << frames << " frames) in " << wall << " s: "
+                  << simulated / wall << " simulated seconds per second\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
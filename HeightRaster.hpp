@@ -0,0 +1,309 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_HEIGHTRASTER_HPP
+#define DRONE_DELIVERY_HEIGHTRASTER_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <glm/glm.hpp>
+#include "Obstacles.hpp"
+
+/**
+ * Max height raster of the obstacles seen from above, baked once from their triangles.
+ * Each texel stores the highest obstacle point within the baked radius from anywhere inside the texel, so a collision
+ * query is a single texel fetch. The result is conservative: it can only be higher than the exact one, by at most
+ * the height variation of the obstacles over about a texel diagonal.
+ */
+class HeightRaster : public HeightObstacles {
+    constexpr static const char MAGIC[4] = {'D', 'D', 'H', 'R'};
+    constexpr static const uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t inputHash;
+        float originX, originZ;
+        float texelSize;
+        float radius;
+        uint32_t dimX, dimZ;
+    };
+
+    glm::vec2 origin{0, 0};
+    float texelSize = 1.0f;
+    float invTexelSize = 1.0f;
+    float bakedRadius = 0.0f;
+    int dimX = 0;
+    int dimZ = 0;
+    std::vector<float> texels; // row major, dimX texels per row
+
+    /**
+     * 64 bit FNV-1a
+     */
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t hashInputs(const std::vector<Triangle>& triangles, float texelsPerUnit, float filterRadius) {
+        uint64_t hash = hashBytes(&VERSION, sizeof(VERSION));
+        hash = hashBytes(&texelsPerUnit, sizeof(texelsPerUnit), hash);
+        hash = hashBytes(&filterRadius, sizeof(filterRadius), hash);
+        for (const auto& t : triangles) {
+            float coordinates[9] = {t.v0.x, t.v0.y, t.v0.z, t.v1.x, t.v1.y, t.v1.z, t.v2.x, t.v2.y, t.v2.z};
+            hash = hashBytes(coordinates, sizeof(coordinates), hash);
+        }
+        return hash;
+    }
+
+    /**
+     * separating axis test between the xz projection of a triangle and an axis aligned rectangle.
+     * Works also for degenerate projections (vertical faces project to segments)
+     */
+    static bool overlapsRectangle(glm::vec2 a, glm::vec2 b, glm::vec2 c, glm::vec2 rectMin, glm::vec2 rectMax) {
+        glm::vec2 triangleMin = glm::min(a, glm::min(b, c));
+        glm::vec2 triangleMax = glm::max(a, glm::max(b, c));
+        if (triangleMax.x < rectMin.x || triangleMin.x > rectMax.x ||
+            triangleMax.y < rectMin.y || triangleMin.y > rectMax.y) return false;
+
+        glm::vec2 corners[4] = {rectMin, {rectMax.x, rectMin.y}, rectMax, {rectMin.x, rectMax.y}};
+        glm::vec2 vertices[3] = {a, b, c};
+        for (int e = 0; e < 3; ++e) {
+            glm::vec2 edge = vertices[(e + 1) % 3] - vertices[e];
+            glm::vec2 axis{- edge.y, edge.x};
+            if (axis == glm::vec2(0)) continue;
+            float triangleLo = glm::dot(axis, vertices[0]), triangleHi = triangleLo;
+            for (int v = 1; v < 3; ++v) {
+                triangleLo = std::min(triangleLo, glm::dot(axis, vertices[v]));
+                triangleHi = std::max(triangleHi, glm::dot(axis, vertices[v]));
+            }
+            float rectLo = glm::dot(axis, corners[0]), rectHi = rectLo;
+            for (int v = 1; v < 4; ++v) {
+                rectLo = std::min(rectLo, glm::dot(axis, corners[v]));
+                rectHi = std::max(rectHi, glm::dot(axis, corners[v]));
+            }
+            if (triangleHi < rectLo || triangleLo > rectHi) return false;
+        }
+        return true;
+    }
+
+    /**
+     * writes in each texel the highest point of the triangles whose projection overlaps it
+     */
+    void rasterize(const std::vector<Triangle>& triangles, std::vector<float>& heights) const {
+        heights.assign(dimX * dimZ, NO_OBSTACLE_HEIGHT);
+        for (const auto& t : triangles) {
+            glm::vec2 a{t.v0.x, t.v0.z}, b{t.v1.x, t.v1.z}, c{t.v2.x, t.v2.z};
+            float top = std::max(t.v0.y, std::max(t.v1.y, t.v2.y));
+            glm::vec2 lo = glm::min(a, glm::min(b, c));
+            glm::vec2 hi = glm::max(a, glm::max(b, c));
+            int minX = texelCoordinate(lo.x, origin.x, dimX), maxX = texelCoordinate(hi.x, origin.x, dimX);
+            int minZ = texelCoordinate(lo.y, origin.y, dimZ), maxZ = texelCoordinate(hi.y, origin.y, dimZ);
+            for (int z = minZ; z <= maxZ; ++z) {
+                for (int x = minX; x <= maxX; ++x) {
+                    float& texel = heights[z * dimX + x];
+                    if (top <= texel) continue;
+                    glm::vec2 rectMin = origin + glm::vec2(x, z) * texelSize;
+                    if (overlapsRectangle(a, b, c, rectMin, rectMin + glm::vec2(texelSize))) texel = top;
+                }
+            }
+        }
+    }
+
+    /**
+     * max filter with a disk: a point inside a texel and an obstacle point inside another texel at most radius apart
+     * have texel centers at most radius + one texel diagonal apart
+     */
+    void dilate(const std::vector<float>& heights) {
+        float maxDistance = bakedRadius * invTexelSize + std::sqrt(2.0f); // in texels
+        int reach = static_cast<int>(std::ceil(maxDistance));
+        std::vector<glm::ivec2> kernel;
+        for (int dz = - reach; dz <= reach; ++dz) {
+            for (int dx = - reach; dx <= reach; ++dx) {
+                if (static_cast<float>(dx * dx + dz * dz) <= maxDistance * maxDistance) kernel.emplace_back(dx, dz);
+            }
+        }
+
+        texels.assign(dimX * dimZ, NO_OBSTACLE_HEIGHT);
+        for (int z = 0; z < dimZ; ++z) {
+            for (int x = 0; x < dimX; ++x) {
+                float source = heights[z * dimX + x];
+                if (source == NO_OBSTACLE_HEIGHT) continue;
+                // scatter instead of gather: most of the city footprint is empty
+                for (auto offset : kernel) {
+                    int tx = x + offset.x, tz = z + offset.y;
+                    if (tx < 0 || tx >= dimX || tz < 0 || tz >= dimZ) continue;
+                    float& texel = texels[tz * dimX + tx];
+                    texel = std::max(texel, source);
+                }
+            }
+        }
+    }
+
+    void checkRadius(float radius) const {
+        if (radius > bakedRadius) {
+            throw std::runtime_error("height raster baked for radius " + std::to_string(bakedRadius) +
+                                     " queried with radius " + std::to_string(radius));
+        }
+    }
+
+    int texelCoordinate(float value, float originValue, int dim) const {
+        int c = static_cast<int>(std::floor((value - originValue) * invTexelSize));
+        return std::clamp(c, 0, dim - 1);
+    }
+
+    bool load(const std::string& path, uint64_t inputHash) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        FileHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.inputHash != inputHash) return false;
+
+        std::vector<float> data(static_cast<size_t>(header.dimX) * header.dimZ);
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(float)));
+        if (!file) return false;
+
+        origin = {header.originX, header.originZ};
+        texelSize = header.texelSize;
+        invTexelSize = 1.0f / texelSize;
+        bakedRadius = header.radius;
+        dimX = static_cast<int>(header.dimX);
+        dimZ = static_cast<int>(header.dimZ);
+        texels.swap(data);
+        return true;
+    }
+
+    void save(const std::string& path, uint64_t inputHash) const {
+        FileHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.inputHash = inputHash;
+        header.originX = origin.x;
+        header.originZ = origin.y;
+        header.texelSize = texelSize;
+        header.radius = bakedRadius;
+        header.dimX = static_cast<uint32_t>(dimX);
+        header.dimZ = static_cast<uint32_t>(dimZ);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(texels.data()), static_cast<std::streamsize>(texels.size() * sizeof(float)));
+        if (!file) std::cout << "Could not save height raster to " << path << "\n";
+    }
+
+public:
+    /**
+     * bakes the raster
+     * @param triangles obstacle triangles in world coordinates
+     * @param texelsPerUnit raster resolution
+     * @param filterRadius collision radius the raster is baked for: queries with a bigger radius are not supported
+     */
+    void bake(const std::vector<Triangle>& triangles, float texelsPerUnit, float filterRadius) {
+        texelSize = 1.0f / texelsPerUnit;
+        invTexelSize = texelsPerUnit;
+        bakedRadius = filterRadius;
+        texels.clear();
+        dimX = dimZ = 0;
+        if (triangles.empty()) return;
+
+        glm::vec2 lo{triangles[0].v0.x, triangles[0].v0.z};
+        glm::vec2 hi = lo;
+        for (const auto& t : triangles) {
+            for (const auto& v : {t.v0, t.v1, t.v2}) {
+                lo = glm::min(lo, glm::vec2(v.x, v.z));
+                hi = glm::max(hi, glm::vec2(v.x, v.z));
+            }
+        }
+        // the footprint grows by the filter radius (and a texel of margin) all around
+        origin = lo - glm::vec2(bakedRadius + texelSize);
+        dimX = static_cast<int>(std::ceil((hi.x - lo.x + 2 * (bakedRadius + texelSize)) * invTexelSize)) + 1;
+        dimZ = static_cast<int>(std::ceil((hi.y - lo.y + 2 * (bakedRadius + texelSize)) * invTexelSize)) + 1;
+
+        std::vector<float> heights;
+        rasterize(triangles, heights);
+        dilate(heights);
+    }
+
+    /**
+     * loads the raster from path if it was baked from the same inputs, otherwise bakes it and saves it there
+     */
+    void loadOrBake(const std::vector<Triangle>& triangles, float texelsPerUnit, float filterRadius, const std::string& path) {
+        uint64_t inputHash = hashInputs(triangles, texelsPerUnit, filterRadius);
+        if (load(path, inputHash)) return;
+        bake(triangles, texelsPerUnit, filterRadius);
+        save(path, inputHash);
+    }
+
+    /**
+     * @param radius has to be lower or equal than the baked radius, the raster is only valid for that: throws otherwise
+     */
+    float highestPointWithin(glm::vec2 center, float radius) const override {
+        checkRadius(radius);
+        int x = static_cast<int>(std::floor((center.x - origin.x) * invTexelSize));
+        int z = static_cast<int>(std::floor((center.y - origin.y) * invTexelSize));
+        if (x < 0 || x >= dimX || z < 0 || z >= dimZ) return NO_OBSTACLE_HEIGHT;
+        return texels[z * dimX + x];
+    }
+
+    /**
+     * walks the texels crossed by the xz projection of the segment in order (DDA): inside each texel the height
+     * of the sphere center is linear, so the first time it goes below the texel height is found exactly
+     * @param radius has to be lower or equal than the baked radius, the raster is only valid for that: throws otherwise
+     */
+    float timeOfImpact(const glm::vec3& from, const glm::vec3& to, float radius) const override {
+        checkRadius(radius);
+        if (texels.empty()) return NO_IMPACT;
+        glm::vec2 start = (glm::vec2(from.x, from.z) - origin) * invTexelSize; // in texels
+        glm::vec2 direction = glm::vec2(to.x - from.x, to.z - from.z) * invTexelSize;
+        float rise = to.y - from.y;
+
+        int x = static_cast<int>(std::floor(start.x));
+        int z = static_cast<int>(std::floor(start.y));
+        int stepX = direction.x > 0 ? 1 : -1;
+        int stepZ = direction.y > 0 ? 1 : -1;
+        const float infinity = std::numeric_limits<float>::infinity();
+        // time at which the segment crosses the next texel border on each axis, and time to cross a whole texel
+        float nextX = direction.x != 0 ? (static_cast<float>(x + (stepX > 0)) - start.x) / direction.x : infinity;
+        float nextZ = direction.y != 0 ? (static_cast<float>(z + (stepZ > 0)) - start.y) / direction.y : infinity;
+        float deltaX = direction.x != 0 ? std::abs(1.0f / direction.x) : infinity;
+        float deltaZ = direction.y != 0 ? std::abs(1.0f / direction.y) : infinity;
+
+        float enter = 0;
+        while (true) {
+            float exit = std::min(1.0f, std::min(nextX, nextZ));
+            bool inside = x >= 0 && x < dimX && z >= 0 && z < dimZ;
+            float height = inside ? texels[z * dimX + x] : NO_OBSTACLE_HEIGHT;
+            if (from.y + rise * enter < height) return enter;
+            if (from.y + rise * exit < height) return std::clamp((height - from.y) / rise, enter, exit);
+            if (exit >= 1.0f) return NO_IMPACT;
+            if (nextX < nextZ) {
+                x += stepX;
+                enter = nextX;
+                nextX += deltaX;
+            } else {
+                z += stepZ;
+                enter = nextZ;
+                nextZ += deltaZ;
+            }
+        }
+    }
+
+    float getBakedRadius() const {
+        return bakedRadius;
+    }
+};
+
+#endif //DRONE_DELIVERY_HEIGHTRASTER_HPP
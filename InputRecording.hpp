@@ -0,0 +1,128 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_INPUTRECORDING_HPP
+#define DRONE_DELIVERY_INPUTRECORDING_HPP
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+
+/**
+ * raw inputs of a frame, as read by getSixAxis
+ */
+struct FrameInputs {
+    float deltaT = 0;
+    glm::vec3 m{0};
+    glm::vec3 r{0};
+    bool fire = false;
+};
+
+/**
+ * Binary format of a recorded session: a header with the seed of rand(), then the inputs of each frame until the end
+ * of the file. Everything the game logic reads from outside is in the file, so replaying it reproduces the session
+ * exactly (on the same build: floating point results can change with the compiler and its flags).
+ */
+namespace InputRecording {
+    constexpr static const char MAGIC[4] = {'D', 'D', 'I', 'R'};
+    constexpr static const uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t seed;
+    };
+
+    // frames are written field by field: 7 floats and a byte, without padding
+    constexpr static const size_t FRAME_SIZE = 7 * sizeof(float) + 1;
+}
+
+/**
+ * Writes the inputs of every frame to a file, while the game is played
+ */
+class InputRecorder {
+private:
+    std::ofstream file;
+
+public:
+    /**
+     * @param seed the seed given to srand() before the session starts
+     */
+    void open(const std::string& path, uint32_t seed) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open recording " + path);
+        }
+        InputRecording::FileHeader header{};
+        std::memcpy(header.magic, InputRecording::MAGIC, sizeof(header.magic));
+        header.version = InputRecording::VERSION;
+        header.seed = seed;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    void record(const FrameInputs& inputs) {
+        char frame[InputRecording::FRAME_SIZE];
+        const float values[7] = {inputs.deltaT, inputs.m.x, inputs.m.y, inputs.m.z, inputs.r.x, inputs.r.y, inputs.r.z};
+        std::memcpy(frame, values, sizeof(values));
+        frame[sizeof(values)] = inputs.fire ? 1 : 0;
+        file.write(frame, sizeof(frame));
+    }
+};
+
+/**
+ * Reads back a file written by InputRecorder, a frame at a time
+ */
+class InputPlayer {
+private:
+    std::ifstream file;
+    uint32_t seed = 0;
+
+public:
+    void open(const std::string& path) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open recording " + path);
+        }
+        InputRecording::FileHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || std::memcmp(header.magic, InputRecording::MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != InputRecording::VERSION) {
+            throw std::runtime_error(path + " is not a recording of this version of the game");
+        }
+        seed = header.seed;
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    uint32_t getSeed() const {
+        return seed;
+    }
+
+    /**
+     * @return false when the recording is over
+     */
+    bool next(FrameInputs& inputs) {
+        char frame[InputRecording::FRAME_SIZE];
+        if (!file.read(frame, sizeof(frame))) return false;
+        float values[7];
+        std::memcpy(values, frame, sizeof(values));
+        inputs.deltaT = values[0];
+        inputs.m = {values[1], values[2], values[3]};
+        inputs.r = {values[4], values[5], values[6]};
+        inputs.fire = frame[sizeof(values)] != 0;
+        return true;
+    }
+};
+
+#endif //DRONE_DELIVERY_INPUTRECORDING_HPP
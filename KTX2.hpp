@@ -0,0 +1,232 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_KTX2_HPP
+#define DRONE_DELIVERY_KTX2_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+/**
+ * Reading and writing of KTX2 textures with all their mip levels already in the file, without supercompression, as
+ * texture-baker writes them. Doesn't depend on Vulkan: the formats are the values of VkFormat.
+ */
+struct KTX2Texture {
+    constexpr static const uint32_t FORMAT_BC1_RGB_SRGB = 132; // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+    constexpr static const uint32_t FORMAT_BC3_SRGB = 138;     // VK_FORMAT_BC3_SRGB_BLOCK
+    // key of the hash of the images the texture was baked from, see hashFiles
+    constexpr static const char* SOURCE_HASH_KEY = "sourceHash";
+
+    uint32_t vkFormat = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<std::vector<unsigned char>> levels; // the largest first
+    std::vector<std::pair<std::string, std::string>> keyValues;
+
+    /**
+     * @return value of key, empty if not in the file
+     */
+    std::string value(const std::string& key) const {
+        for (const auto& keyValue : keyValues) {
+            if (keyValue.first == key) return keyValue.second;
+        }
+        return "";
+    }
+
+    /**
+     * 64 bit FNV-1a of the contents of the files, in hexadecimal
+     * @return empty if a file can't be read
+     */
+    static std::string hashFiles(const std::vector<std::string>& files) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const auto& file : files) {
+            std::ifstream stream(file, std::ios::binary);
+            if (!stream.is_open()) return "";
+            char buffer[65536];
+            while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0) {
+                for (std::streamsize i = 0; i < stream.gcount(); i++) {
+                    hash ^= static_cast<unsigned char>(buffer[i]);
+                    hash *= 1099511628211ull;
+                }
+            }
+        }
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+        return hex;
+    }
+
+    /**
+     * @return false if the texture was baked from images different from the files. When the files can't be read the
+     * baked texture is all there is, so it is taken as up to date
+     */
+    bool isBakedFrom(const std::vector<std::string>& files) const {
+        std::string hash = hashFiles(files);
+        return hash.empty() || value(SOURCE_HASH_KEY) == hash;
+    }
+
+    static bool exists(const std::string& file) {
+        return std::ifstream(file, std::ios::binary).is_open();
+    }
+
+    static KTX2Texture read(const std::string& file) {
+        std::ifstream stream(file, std::ios::ate | std::ios::binary);
+        if (!stream.is_open()) {
+            throw std::runtime_error("failed to open texture " + file);
+        }
+        std::vector<unsigned char> bytes(static_cast<size_t>(stream.tellg()));
+        stream.seekg(0);
+        stream.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+        if (bytes.size() < HEADER_BYTES || memcmp(bytes.data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+            throw std::runtime_error("not a KTX2 texture: " + file);
+        }
+        KTX2Texture texture;
+        texture.vkFormat = read32(bytes, 12);
+        texture.width = read32(bytes, 20);
+        texture.height = read32(bytes, 24);
+        uint32_t levelCount = read32(bytes, 40);
+        if (read32(bytes, 28) != 0 || read32(bytes, 32) > 1 || read32(bytes, 36) != 1 || read32(bytes, 44) != 0 ||
+            levelCount == 0) {
+            throw std::runtime_error("only 2D KTX2 textures with their levels and no supercompression are supported: "
+                                     + file);
+        }
+        if (bytes.size() < HEADER_BYTES + levelCount * 24) {
+            throw std::runtime_error("truncated KTX2 texture: " + file);
+        }
+        for (uint32_t level = 0; level < levelCount; level++) {
+            uint64_t offset = read64(bytes, HEADER_BYTES + level * 24);
+            uint64_t length = read64(bytes, HEADER_BYTES + level * 24 + 8);
+            if (offset + length > bytes.size()) {
+                throw std::runtime_error("truncated KTX2 texture: " + file);
+            }
+            texture.levels.emplace_back(bytes.begin() + static_cast<std::ptrdiff_t>(offset),
+                                        bytes.begin() + static_cast<std::ptrdiff_t>(offset + length));
+        }
+
+        uint32_t kvdOffset = read32(bytes, 56), kvdLength = read32(bytes, 60);
+        if (static_cast<uint64_t>(kvdOffset) + kvdLength > bytes.size()) {
+            throw std::runtime_error("truncated KTX2 texture: " + file);
+        }
+        uint64_t kvdEnd = static_cast<uint64_t>(kvdOffset) + kvdLength;
+        for (uint64_t position = kvdOffset; position + 4 <= kvdEnd;) {
+            uint32_t length = read32(bytes, position);
+            // the pair has to be inside the data before any of it is read
+            if (length == 0 || position + 4 + length > kvdEnd) break;
+            const char* keyValue = reinterpret_cast<const char*>(&bytes[position + 4]);
+            size_t keyLength = strnlen(keyValue, length);
+            std::string value(keyValue + std::min<size_t>(keyLength + 1, length), keyValue + length);
+            if (!value.empty() && value.back() == '\0') value.pop_back();
+            texture.keyValues.emplace_back(std::string(keyValue, keyLength), value);
+            position += 4 + (length + 3) / 4 * 4;
+        }
+        return texture;
+    }
+
+    /**
+     * levels are written from the smallest, as the format wants, each aligned to its blocks
+     */
+    void write(const std::string& file) const {
+        uint32_t blockBytes = vkFormat == FORMAT_BC1_RGB_SRGB ? 8 : 16;
+        std::vector<unsigned char> bytes(HEADER_BYTES + levels.size() * 24, 0);
+        memcpy(bytes.data(), IDENTIFIER, sizeof(IDENTIFIER));
+        write32(bytes, 12, vkFormat);
+        write32(bytes, 16, 1); // typeSize
+        write32(bytes, 20, width);
+        write32(bytes, 24, height);
+        write32(bytes, 36, 1); // faceCount
+        write32(bytes, 40, static_cast<uint32_t>(levels.size()));
+
+        std::vector<uint32_t> dfd = dataFormatDescriptor(blockBytes);
+        write32(bytes, 48, static_cast<uint32_t>(bytes.size()));
+        write32(bytes, 52, static_cast<uint32_t>(dfd.size() * 4));
+        for (uint32_t word : dfd) append32(bytes, word);
+
+        write32(bytes, 56, static_cast<uint32_t>(bytes.size()));
+        for (const auto& keyValue : keyValues) {
+            uint32_t length = static_cast<uint32_t>(keyValue.first.size() + 1 + keyValue.second.size() + 1);
+            append32(bytes, length);
+            bytes.insert(bytes.end(), keyValue.first.begin(), keyValue.first.end());
+            bytes.push_back(0);
+            bytes.insert(bytes.end(), keyValue.second.begin(), keyValue.second.end());
+            bytes.push_back(0);
+            bytes.resize((bytes.size() + 3) / 4 * 4, 0);
+        }
+        write32(bytes, 60, static_cast<uint32_t>(bytes.size()) - read32(bytes, 56));
+        if (keyValues.empty()) write32(bytes, 56, 0);
+
+        for (size_t level = levels.size(); level-- > 0;) {
+            bytes.resize((bytes.size() + blockBytes - 1) / blockBytes * blockBytes, 0);
+            write64(bytes, HEADER_BYTES + level * 24, bytes.size());
+            write64(bytes, HEADER_BYTES + level * 24 + 8, levels[level].size());
+            write64(bytes, HEADER_BYTES + level * 24 + 16, levels[level].size());
+            bytes.insert(bytes.end(), levels[level].begin(), levels[level].end());
+        }
+
+        std::ofstream stream(file, std::ios::binary);
+        if (!stream.is_open()) {
+            throw std::runtime_error("failed to write texture " + file);
+        }
+        stream.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+private:
+    constexpr static const unsigned char IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    constexpr static const size_t HEADER_BYTES = 80; // identifier, header and index, before the level index
+
+    /**
+     * basic descriptor block of an sRGB BC1 or BC3 texture: one sample for the colors, another for the alpha of BC3
+     */
+    std::vector<uint32_t> dataFormatDescriptor(uint32_t blockBytes) const {
+        bool alpha = vkFormat == FORMAT_BC3_SRGB;
+        uint32_t samples = alpha ? 2 : 1;
+        uint32_t blockSize = 24 + 16 * samples;
+        std::vector<uint32_t> dfd = {
+                4 + blockSize,                        // total size
+                0,                                    // vendor: Khronos, type: basic
+                2 | (blockSize << 16),                // version 1.3
+                (alpha ? 130u : 128u) | (1u << 8) | (2u << 16), // BC3 or BC1A model, BT.709 primaries, sRGB transfer
+                3 | (3 << 8),                         // 4x4 texel blocks
+                blockBytes,
+                0,
+        };
+        if (alpha) {
+            dfd.insert(dfd.end(), {0 | (63u << 16) | (15u << 24), 0, 0, 0xFFFFFFFF}); // alpha, first 8 bytes
+            dfd.insert(dfd.end(), {64 | (63u << 16), 0, 0, 0xFFFFFFFF});               // colors, last 8 bytes
+        } else {
+            dfd.insert(dfd.end(), {0 | (63u << 16), 0, 0, 0xFFFFFFFF});
+        }
+        return dfd;
+    }
+
+    static uint32_t read32(const std::vector<unsigned char>& bytes, size_t offset) {
+        return static_cast<uint32_t>(bytes[offset]) | static_cast<uint32_t>(bytes[offset + 1]) << 8 |
+               static_cast<uint32_t>(bytes[offset + 2]) << 16 | static_cast<uint32_t>(bytes[offset + 3]) << 24;
+    }
+
+    static uint64_t read64(const std::vector<unsigned char>& bytes, size_t offset) {
+        return static_cast<uint64_t>(read32(bytes, offset)) | static_cast<uint64_t>(read32(bytes, offset + 4)) << 32;
+    }
+
+    static void write32(std::vector<unsigned char>& bytes, size_t offset, uint32_t value) {
+        for (int i = 0; i < 4; i++) bytes[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+
+    static void write64(std::vector<unsigned char>& bytes, size_t offset, uint64_t value) {
+        write32(bytes, offset, static_cast<uint32_t>(value));
+        write32(bytes, offset + 4, static_cast<uint32_t>(value >> 32));
+    }
+
+    static void append32(std::vector<unsigned char>& bytes, uint32_t value) {
+        bytes.resize(bytes.size() + 4);
+        write32(bytes, bytes.size() - 4, value);
+    }
+};
+
+#endif //DRONE_DELIVERY_KTX2_HPP
@@ -0,0 +1,389 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_LEVELOFDETAIL_HPP
+#define DRONE_DELIVERY_LEVELOFDETAIL_HPP
+
+#include <vector>
+#include <array>
+#include <string>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "MeshCache.hpp"
+
+/**
+ * Simplification of a triangle mesh by edge collapses ordered by quadric error (Garland-Heckbert).
+ * The vertices with the same position are welded, so the collapses don't open the seams where a position has a vertex
+ * per face. Each collapse moves a position onto the other end of the edge (half-edge collapse): no vertex is created,
+ * so every simplified mesh is an index list on the vertices of the original one, and the corners that move take the
+ * vertex of the destination whose normal is the closest to theirs, with its attributes.
+ * Vulkan-free: only needs the pos and norm members of the vertices.
+ */
+class MeshSimplifier {
+    /**
+     * symmetric 4x4 matrix of the sum of the squared distances from planes, and the weight of the planes
+     */
+    struct Quadric {
+        double a[10] = {};
+        double weight = 0;
+
+        void addPlane(const glm::dvec3& normal, double distance, double planeWeight) {
+            double p[4] = {normal.x, normal.y, normal.z, distance};
+            int k = 0;
+            for (int i = 0; i < 4; ++i) {
+                for (int j = i; j < 4; ++j) a[k++] += planeWeight * p[i] * p[j];
+            }
+            weight += planeWeight;
+        }
+
+        void add(const Quadric& other) {
+            for (int k = 0; k < 10; ++k) a[k] += other.a[k];
+            weight += other.weight;
+        }
+
+        /**
+         * @return weighted mean of the distances of point from the planes
+         */
+        double error(const glm::vec3& point) const {
+            double p[4] = {point.x, point.y, point.z, 1};
+            double sum = 0;
+            int k = 0;
+            for (int i = 0; i < 4; ++i) {
+                for (int j = i; j < 4; ++j) sum += (i == j ? 1 : 2) * a[k++] * p[i] * p[j];
+            }
+            return weight > 0 ? std::sqrt(std::max(sum, 0.0) / weight) : 0;
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from, to;
+        uint32_t fromVersion, toVersion;
+
+        bool operator>(const Collapse& other) const {
+            return cost > other.cost;
+        }
+    };
+
+public:
+    // changes with the simplification, so that the levels cached by loadOrBuildLodChain are built again
+    constexpr static const uint32_t VERSION = 2;
+
+private:
+    // the borders of open surfaces (e.g. the bottom of the buildings) keep their outline
+    constexpr static const double BORDER_WEIGHT = 10.0;
+    // a collapse can't turn a triangle by more than about 78 degrees
+    constexpr static const float MIN_NORMAL_DOT = 0.2f;
+
+    std::vector<glm::vec3> positions; // one per welded position
+    std::vector<glm::vec3> normals;   // one per vertex
+    std::vector<uint32_t> groupOfVertex;
+    std::vector<std::vector<uint32_t>> verticesOfGroup;
+    std::vector<std::vector<uint32_t>> trianglesOfGroup; // may hold removed triangles, and a triangle twice
+    std::vector<Quadric> quadrics;
+    std::vector<uint32_t> versions;
+    std::vector<bool> removedGroups;
+
+    std::vector<uint32_t> corners; // 3 vertices per triangle
+    std::vector<glm::vec3> originalNormals; // not normalized, one per triangle
+    std::vector<bool> removedTriangles;
+    size_t triangleCount = 0;
+    float error = 0;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+    uint32_t group(uint32_t triangle, int corner) const {
+        return groupOfVertex[corners[3 * triangle + corner]];
+    }
+
+    bool contains(uint32_t triangle, uint32_t g) const {
+        return group(triangle, 0) == g || group(triangle, 1) == g || group(triangle, 2) == g;
+    }
+
+    glm::vec3 normal(uint32_t triangle, uint32_t moved, const glm::vec3& position) const {
+        glm::vec3 p[3];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t g = group(triangle, c);
+            p[c] = g == moved ? position : positions[g];
+        }
+        return glm::cross(p[1] - p[0], p[2] - p[0]);
+    }
+
+    /**
+     * @return false if moving from onto to would flip or collapse a triangle that isn't removed by the collapse.
+     * Triangles are compared with their orientation in the original mesh, so that many small turns can't add up to a flip
+     */
+    bool keepsOrientation(uint32_t from, uint32_t to) const {
+        for (uint32_t triangle : trianglesOfGroup[from]) {
+            if (removedTriangles[triangle] || contains(triangle, to)) continue;
+            glm::vec3 before = originalNormals[triangle];
+            if (before == glm::vec3(0)) before = normal(triangle, from, positions[from]);
+            glm::vec3 after = normal(triangle, from, positions[to]);
+            float lengths = glm::length(before) * glm::length(after);
+            if (lengths == 0 || glm::dot(before, after) < MIN_NORMAL_DOT * lengths) return false;
+        }
+        return true;
+    }
+
+    void pushCollapse(uint32_t a, uint32_t b) {
+        Quadric sum = quadrics[a];
+        sum.add(quadrics[b]);
+        double toB = sum.error(positions[b]);
+        double toA = sum.error(positions[a]);
+        if (toB <= toA) collapses.push({toB, a, b, versions[a], versions[b]});
+        else collapses.push({toA, b, a, versions[b], versions[a]});
+    }
+
+    bool isStale(const Collapse& collapse) const {
+        if (removedGroups[collapse.from] || removedGroups[collapse.to] ||
+            versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion) return true;
+        for (uint32_t triangle : trianglesOfGroup[collapse.from]) {
+            if (!removedTriangles[triangle] && contains(triangle, collapse.to)) return false;
+        }
+        return true; // no longer an edge
+    }
+
+    /**
+     * @return the vertex of to that replaces vertex in the corners moved onto to
+     */
+    uint32_t closestVertex(uint32_t to, uint32_t vertex) const {
+        uint32_t best = verticesOfGroup[to][0];
+        float bestDot = - std::numeric_limits<float>::max();
+        for (uint32_t candidate : verticesOfGroup[to]) {
+            float d = glm::dot(normals[candidate], normals[vertex]);
+            if (d > bestDot) {
+                bestDot = d;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    void collapse(uint32_t from, uint32_t to) {
+        for (uint32_t triangle : trianglesOfGroup[from]) {
+            if (removedTriangles[triangle]) continue;
+            if (contains(triangle, to)) {
+                removedTriangles[triangle] = true;
+                triangleCount--;
+                continue;
+            }
+            for (int c = 0; c < 3; ++c) {
+                uint32_t& vertex = corners[3 * triangle + c];
+                if (groupOfVertex[vertex] == from) vertex = closestVertex(to, vertex);
+            }
+            trianglesOfGroup[to].push_back(triangle);
+        }
+        trianglesOfGroup[from].clear();
+        removedGroups[from] = true;
+        quadrics[to].add(quadrics[from]);
+        versions[to]++;
+
+        // the edges around to are weighed again with its new quadric
+        auto& around = trianglesOfGroup[to];
+        around.erase(std::remove_if(around.begin(), around.end(),
+                                    [this](uint32_t triangle) { return removedTriangles[triangle]; }), around.end());
+        for (uint32_t triangle : around) {
+            for (int c = 0; c < 3; ++c) {
+                uint32_t g = group(triangle, c);
+                if (g != to) pushCollapse(to, g);
+            }
+        }
+    }
+
+public:
+    /**
+     * @param vertices any vertex with pos and norm members
+     */
+    template<class Vert>
+    MeshSimplifier(const std::vector<Vert>& vertices, const std::vector<uint32_t>& indices) : corners(indices) {
+        // weld by the bits of the positions
+        std::unordered_map<std::string, uint32_t> groups;
+        groupOfVertex.resize(vertices.size());
+        normals.resize(vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            glm::vec3 position = vertices[v].pos;
+            std::string key(reinterpret_cast<const char*>(&position), sizeof(glm::vec3));
+            auto inserted = groups.emplace(key, static_cast<uint32_t>(positions.size()));
+            if (inserted.second) {
+                positions.push_back(position);
+                verticesOfGroup.emplace_back();
+            }
+            groupOfVertex[v] = inserted.first->second;
+            verticesOfGroup[inserted.first->second].push_back(static_cast<uint32_t>(v));
+            normals[v] = vertices[v].norm;
+        }
+        size_t groupCount = positions.size();
+        trianglesOfGroup.resize(groupCount);
+        quadrics.resize(groupCount);
+        versions.resize(groupCount, 0);
+        removedGroups.resize(groupCount, false);
+
+        // planes of the faces, weighted by their area
+        size_t triangles = corners.size() / 3;
+        corners.resize(3 * triangles);
+        removedTriangles.resize(triangles, false);
+        originalNormals.resize(triangles, glm::vec3(0));
+        std::unordered_map<uint64_t, int> edgeUses;
+        auto edgeKey = [](uint32_t a, uint32_t b) {
+            return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+        };
+        for (uint32_t t = 0; t < triangles; ++t) {
+            uint32_t g[3] = {group(t, 0), group(t, 1), group(t, 2)};
+            if (g[0] == g[1] || g[1] == g[2] || g[0] == g[2]) {
+                removedTriangles[t] = true;
+                continue;
+            }
+            triangleCount++;
+            originalNormals[t] = normal(t, g[0], positions[g[0]]);
+            glm::dvec3 n = glm::cross(glm::dvec3(positions[g[1]] - positions[g[0]]),
+                                      glm::dvec3(positions[g[2]] - positions[g[0]]));
+            double area = glm::length(n);
+            if (area > 0) n /= area;
+            for (uint32_t c : g) {
+                trianglesOfGroup[c].push_back(t);
+                quadrics[c].addPlane(n, - glm::dot(n, glm::dvec3(positions[c])), area * 0.5);
+            }
+            for (int c = 0; c < 3; ++c) edgeUses[edgeKey(g[c], g[(c + 1) % 3])]++;
+        }
+
+        // planes through the borders, perpendicular to their face
+        for (uint32_t t = 0; t < triangles; ++t) {
+            if (removedTriangles[t]) continue;
+            uint32_t g[3] = {group(t, 0), group(t, 1), group(t, 2)};
+            glm::dvec3 n = glm::cross(glm::dvec3(positions[g[1]] - positions[g[0]]),
+                                      glm::dvec3(positions[g[2]] - positions[g[0]]));
+            for (int c = 0; c < 3; ++c) {
+                uint32_t a = g[c], b = g[(c + 1) % 3];
+                if (edgeUses[edgeKey(a, b)] != 1) continue;
+                glm::dvec3 edge = glm::dvec3(positions[b] - positions[a]);
+                glm::dvec3 border = glm::cross(edge, n);
+                double length = glm::length(border);
+                if (length == 0) continue;
+                border /= length;
+                double distance = - glm::dot(border, glm::dvec3(positions[a]));
+                double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+                quadrics[a].addPlane(border, distance, weight);
+                quadrics[b].addPlane(border, distance, weight);
+            }
+        }
+
+        for (const auto& edge : edgeUses) {
+            pushCollapse(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first & 0xffffffffu));
+        }
+    }
+
+    /**
+     * collapses edges, cheapest first, until at most targetTriangles are left or the next collapse would move the
+     * surface farther than maxError. Can be called again with lower targets, to build the levels one after the other
+     */
+    void simplify(size_t targetTriangles, float maxError) {
+        while (triangleCount > targetTriangles && !collapses.empty()) {
+            Collapse next = collapses.top();
+            if (next.cost > maxError) break;
+            collapses.pop();
+            if (isStale(next) || !keepsOrientation(next.from, next.to)) continue;
+            collapse(next.from, next.to);
+            error = std::max(error, static_cast<float>(next.cost));
+        }
+    }
+
+    std::vector<uint32_t> getIndices() const {
+        std::vector<uint32_t> indices;
+        indices.reserve(3 * triangleCount);
+        for (size_t t = 0; t < removedTriangles.size(); ++t) {
+            if (removedTriangles[t]) continue;
+            indices.insert(indices.end(), corners.begin() + 3 * t, corners.begin() + 3 * t + 3);
+        }
+        return indices;
+    }
+
+    /**
+     * @return index in the original mesh of each triangle left, in the order of getIndices
+     */
+    std::vector<uint32_t> getTriangles() const {
+        std::vector<uint32_t> triangles;
+        triangles.reserve(triangleCount);
+        for (size_t t = 0; t < removedTriangles.size(); ++t) {
+            if (!removedTriangles[t]) triangles.push_back(static_cast<uint32_t>(t));
+        }
+        return triangles;
+    }
+
+    size_t getTriangleCount() const {
+        return triangleCount;
+    }
+
+    /**
+     * @return largest error of the collapses done, in the units of the positions
+     */
+    float getError() const {
+        return error;
+    }
+};
+
+/**
+ * Levels of detail of a mesh: level 0 is the mesh itself, every next level keeps at most ratio of the triangles of
+ * the one before, with an error below levelError times the level. Levels that can't be simplified further within
+ * their error repeat the one before.
+ * @return the index lists of the levels, all on the vertices of the mesh
+ */
+template<class Vert>
+std::vector<std::vector<uint32_t>> buildLodChain(const std::vector<Vert>& vertices, const std::vector<uint32_t>& indices,
+                                                 int levels, float ratio, float levelError) {
+    std::vector<std::vector<uint32_t>> chain{indices};
+    MeshSimplifier simplifier(vertices, indices);
+    for (int level = 1; level < levels; ++level) {
+        size_t target = static_cast<size_t>(static_cast<float>(chain.back().size() / 3) * ratio);
+        simplifier.simplify(target, levelError * static_cast<float>(level));
+        chain.push_back(simplifier.getIndices());
+    }
+    return chain;
+}
+
+/**
+ * buildLodChain, unless the levels saved at path were built from the same mesh with the same parameters: then they
+ * are read from there. Otherwise they are saved there after they are built
+ * @param cached set to true if the levels were read from path
+ */
+template<class Vert>
+std::vector<std::vector<uint32_t>> loadOrBuildLodChain(const std::string& path, const std::vector<Vert>& vertices,
+                                                       const std::vector<uint32_t>& indices, int levels, float ratio,
+                                                       float levelError, bool& cached) {
+    uint64_t sourceHash = MeshCache::hashBytes(vertices.data(), vertices.size() * sizeof(Vert));
+    sourceHash = MeshCache::hashBytes(indices.data(), indices.size() * sizeof(uint32_t), sourceHash);
+    uint64_t parametersHash = MeshCache::hashBytes(&MeshSimplifier::VERSION, sizeof(MeshSimplifier::VERSION));
+    parametersHash = MeshCache::hashBytes(&levels, sizeof(levels), parametersHash);
+    parametersHash = MeshCache::hashBytes(&ratio, sizeof(ratio), parametersHash);
+    parametersHash = MeshCache::hashBytes(&levelError, sizeof(levelError), parametersHash);
+
+    std::vector<std::vector<uint32_t>> chain;
+    cached = MeshCache::loadLevels(path, sourceHash, parametersHash, chain);
+    if (cached) return chain;
+    chain = buildLodChain(vertices, indices, levels, ratio, levelError);
+    MeshCache::saveLevels(path, sourceHash, parametersHash, chain);
+    return chain;
+}
+
+/**
+ * @param current level drawn in the last frame
+ * @param screenSize projected size of the object, in the unit of thresholds
+ * @param thresholds screen size under which each level is left for the next one, decreasing
+ * @param hysteresis fraction of a threshold that has to be crossed to change level: an object right on a threshold
+ * doesn't switch at every frame
+ */
+template<size_t N>
+int selectLevelOfDetail(int current, float screenSize, const std::array<float, N>& thresholds, float hysteresis) {
+    int level = current;
+    while (level < static_cast<int>(N) && screenSize < thresholds[level] * (1 - hysteresis)) level++;
+    while (level > 0 && screenSize > thresholds[level - 1] * (1 + hysteresis)) level--;
+    return level;
+}
+
+#endif //DRONE_DELIVERY_LEVELOFDETAIL_HPP
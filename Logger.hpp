@@ -7,6 +7,7 @@
 #include <iostream>
 #include <map>
 #include <iomanip>
+#include <functional>
 
 class Logger {
     std::ostream& stream;
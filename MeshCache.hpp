@@ -0,0 +1,245 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_MESHCACHE_HPP
+#define DRONE_DELIVERY_MESHCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "TaskLog.hpp"
+
+/**
+ * A file mapped in memory, read only, for as long as the object lives. Where mmap isn't available the file is read
+ */
+class MappedFile {
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::vector<unsigned char> contents;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream) return;
+        contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        bytes = contents.data();
+        length = contents.size();
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return;
+        struct stat status{};
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<const unsigned char*>(mapped);
+                length = static_cast<size_t>(status.st_size);
+            }
+        }
+        close(descriptor); // the mapping stays valid
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @return false if the file couldn't be opened or is empty
+     */
+    bool isOpen() const {
+        return bytes != nullptr;
+    }
+
+    const unsigned char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+/**
+ * Cache of the vertices and indices of a model, as the model holds them after decoding its file: loading a model
+ * again is a copy out of the mapped cache, instead of decrypting, inflating and parsing the file. The cache is saved
+ * next to the model and is only valid for the same bytes of the model and the same vertex layout.
+ * Index lists computed from the mesh, as its levels of detail, can be cached next to it in the same way.
+ */
+class MeshCache {
+    constexpr static const char MAGIC[4] = {'D', 'D', 'M', 'C'};
+    constexpr static const uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t layoutHash;
+        uint32_t vertexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t padding;
+    };
+
+    constexpr static const char LEVELS_MAGIC[4] = {'D', 'D', 'L', 'C'};
+
+    struct LevelsHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t parametersHash;
+        uint32_t levelCount;
+        uint32_t indexCount;
+    };
+
+public:
+    /**
+     * 64 bit FNV-1a
+     */
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * @return hash of the bytes of the model file, 0 if it can't be read
+     */
+    static uint64_t hashFile(const std::string& path) {
+        MappedFile file(path);
+        return file.isOpen() ? hashBytes(file.data(), file.size()) : 0;
+    }
+
+    static std::string cacheFile(const std::string& model) {
+        return model + ".meshcache";
+    }
+
+    /**
+     * @return false, leaving vertices and indices untouched, if there is no cache for the same source and layout
+     */
+    template <class Vert>
+    static bool load(const std::string& path, uint64_t sourceHash, uint64_t layoutHash,
+                     std::vector<Vert>& vertices, std::vector<uint32_t>& indices) {
+        MappedFile file(path);
+        if (!file.isOpen() || file.size() < sizeof(FileHeader)) return false;
+        FileHeader header{};
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.sourceHash != sourceHash || header.layoutHash != layoutHash || header.vertexSize != sizeof(Vert) ||
+            file.size() != sizeof(FileHeader) + static_cast<size_t>(header.vertexCount) * sizeof(Vert) +
+                           static_cast<size_t>(header.indexCount) * sizeof(uint32_t)) return false;
+
+        const unsigned char* data = file.data() + sizeof(FileHeader);
+        vertices.resize(header.vertexCount);
+        std::memcpy(vertices.data(), data, vertices.size() * sizeof(Vert));
+        indices.resize(header.indexCount);
+        std::memcpy(indices.data(), data + vertices.size() * sizeof(Vert), indices.size() * sizeof(uint32_t));
+        return true;
+    }
+
+    template <class Vert>
+    static void save(const std::string& path, uint64_t sourceHash, uint64_t layoutHash,
+                     const std::vector<Vert>& vertices, const std::vector<uint32_t>& indices) {
+        FileHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+        header.layoutHash = layoutHash;
+        header.vertexSize = sizeof(Vert);
+        header.vertexCount = static_cast<uint32_t>(vertices.size());
+        header.indexCount = static_cast<uint32_t>(indices.size());
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(vertices.data()), static_cast<std::streamsize>(vertices.size() * sizeof(Vert)));
+        file.write(reinterpret_cast<const char*>(indices.data()), static_cast<std::streamsize>(indices.size() * sizeof(uint32_t)));
+        if (!file) TaskLog::stream() << "Could not save mesh cache to " << path << "\n";
+    }
+
+    static std::string levelsFile(const std::string& model) {
+        return model + ".lodcache";
+    }
+
+    /**
+     * reads index lists saved by saveLevels, e.g. the levels of detail of a mesh
+     * @param sourceHash of the mesh the levels were built from
+     * @param parametersHash of how they were built
+     * @return false, leaving levels untouched, if there are no levels for the same source and parameters
+     */
+    static bool loadLevels(const std::string& path, uint64_t sourceHash, uint64_t parametersHash,
+                           std::vector<std::vector<uint32_t>>& levels) {
+        MappedFile file(path);
+        if (!file.isOpen() || file.size() < sizeof(LevelsHeader)) return false;
+        LevelsHeader header{};
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, LEVELS_MAGIC, sizeof(LEVELS_MAGIC)) != 0 || header.version != VERSION ||
+            header.sourceHash != sourceHash || header.parametersHash != parametersHash ||
+            file.size() != sizeof(LevelsHeader) + (static_cast<size_t>(header.levelCount) + header.indexCount) *
+                           sizeof(uint32_t)) return false;
+
+        const unsigned char* data = file.data() + sizeof(LevelsHeader);
+        std::vector<uint32_t> sizes(header.levelCount);
+        std::memcpy(sizes.data(), data, sizes.size() * sizeof(uint32_t));
+        data += sizes.size() * sizeof(uint32_t);
+        size_t total = 0;
+        for (uint32_t size : sizes) total += size;
+        if (total != header.indexCount) return false;
+
+        std::vector<std::vector<uint32_t>> loaded(header.levelCount);
+        for (size_t level = 0; level < loaded.size(); ++level) {
+            loaded[level].resize(sizes[level]);
+            std::memcpy(loaded[level].data(), data, sizes[level] * sizeof(uint32_t));
+            data += sizes[level] * sizeof(uint32_t);
+        }
+        levels.swap(loaded);
+        return true;
+    }
+
+    static void saveLevels(const std::string& path, uint64_t sourceHash, uint64_t parametersHash,
+                           const std::vector<std::vector<uint32_t>>& levels) {
+        LevelsHeader header{};
+        std::memcpy(header.magic, LEVELS_MAGIC, sizeof(LEVELS_MAGIC));
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+        header.parametersHash = parametersHash;
+        header.levelCount = static_cast<uint32_t>(levels.size());
+        std::vector<uint32_t> sizes;
+        for (const auto& level : levels) {
+            sizes.push_back(static_cast<uint32_t>(level.size()));
+            header.indexCount += sizes.back();
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sizes.data()), static_cast<std::streamsize>(sizes.size() * sizeof(uint32_t)));
+        for (const auto& level : levels) {
+            file.write(reinterpret_cast<const char*>(level.data()), static_cast<std::streamsize>(level.size() * sizeof(uint32_t)));
+        }
+        if (!file) TaskLog::stream() << "Could not save levels cache to " << path << "\n";
+    }
+};
+
+#endif //DRONE_DELIVERY_MESHCACHE_HPP
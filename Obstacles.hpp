@@ -0,0 +1,104 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_OBSTACLES_HPP
+#define DRONE_DELIVERY_OBSTACLES_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+struct Triangle {
+    glm::vec3 v0, v1, v2;
+};
+
+/**
+ * appends the triangles of an indexed mesh to a triangle soup
+ * @param vertices mesh vertices: only the pos member is used
+ * @param indices triangle list indices
+ * @param translation applied to the vertices to bring them to world coordinates
+ */
+template<class Vert>
+void appendTriangles(std::vector<Triangle>& triangles, const std::vector<Vert>& vertices,
+                     const std::vector<uint32_t>& indices, glm::vec3 translation) {
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        triangles.push_back({vertices[indices[i]].pos + translation,
+                             vertices[indices[i + 1]].pos + translation,
+                             vertices[indices[i + 2]].pos + translation});
+    }
+}
+
+/**
+ * Static geometry the plane has to avoid, queried by the plane's collision detection
+ */
+class Obstacles {
+    // the default sweep samples the segment at steps of this fraction of the radius, then bisects the first hit
+    constexpr static const float SWEEP_STEP = 0.5f;
+    constexpr static const int SWEEP_REFINEMENTS = 8;
+
+public:
+    // time of impact returned when the sweep doesn't hit anything
+    constexpr static const float NO_IMPACT = std::numeric_limits<float>::infinity();
+
+    /**
+     * @param center center of the sphere approximating the plane
+     * @param radius radius of the sphere
+     * @return true if the sphere touches the obstacles
+     */
+    virtual bool collidesWith(const glm::vec3& center, float radius) const = 0;
+
+    /**
+     * sweeps a sphere along a segment and finds when it first touches the obstacles.
+     * The default implementation samples collidesWith along the segment, so it can miss features thinner than
+     * SWEEP_STEP * radius: implementations with an acceleration structure should override it with an exact sweep
+     * @param from center of the sphere at time 0
+     * @param to center of the sphere at time 1
+     * @return time of impact in [0, 1], or NO_IMPACT
+     */
+    virtual float timeOfImpact(const glm::vec3& from, const glm::vec3& to, float radius) const {
+        if (collidesWith(from, radius)) return 0;
+        int steps = std::max(1, static_cast<int>(std::ceil(glm::length(to - from) / (SWEEP_STEP * radius))));
+        float free = 0;
+        for (int i = 1; i <= steps; ++i) {
+            float hit = static_cast<float>(i) / steps;
+            if (collidesWith(from + (to - from) * hit, radius)) {
+                for (int j = 0; j < SWEEP_REFINEMENTS; ++j) {
+                    float middle = (free + hit) / 2;
+                    if (collidesWith(from + (to - from) * middle, radius)) hit = middle;
+                    else free = middle;
+                }
+                return hit;
+            }
+            free = hit;
+        }
+        return NO_IMPACT;
+    }
+};
+
+/**
+ * Obstacles only described by points: a sphere collides if any point inside the vertical cylinder around it is higher
+ * than its center
+ */
+class HeightObstacles : public Obstacles {
+public:
+    // height returned when no obstacle point is found: lower than the ground, so it never causes a collision by itself
+    constexpr static const float NO_OBSTACLE_HEIGHT = -1.0f;
+
+    /**
+     * finds the highest obstacle point inside a vertical cylinder
+     * @param center x, z coordinates of the cylinder axis
+     * @param radius radius of the cylinder
+     * @return the highest y among the obstacle points strictly inside the cylinder, or NO_OBSTACLE_HEIGHT if there are none
+     */
+    virtual float highestPointWithin(glm::vec2 center, float radius) const = 0;
+
+    bool collidesWith(const glm::vec3& center, float radius) const override {
+        return highestPointWithin(glm::vec2(center.x, center.z), radius) > center.y;
+    }
+};
+
+#endif //DRONE_DELIVERY_OBSTACLES_HPP
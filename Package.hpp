@@ -28,7 +28,8 @@ private:
     const vec3 FRICTION = vec3(5, 1, 5); // stronger horizontal friction makes dropping easier
 
     // state of the plane in world coordinates
-    vec3 position;
+    vec3 position{0, -2, 0};
+    vec3 previousPosition{0, -2, 0}; // position at the previous physics step, interpolated with the current one for rendering
     vec3 speed{0, 0, 0};
     vec3 externalAccelerations{0, - 3, 0};
     // e.g. gravity only would be (0, -9.81, 0)
@@ -61,34 +62,36 @@ public:
     }
 
     /**
-     * computes the world matrix for a new frame using the command inputs and stores it internally for other functions
-     * @return updated world matrix
+     * advances the simulation of the package by a physics step using the command inputs
+     * @param deltaT duration of the step
      */
-    mat4 computeWorldMatrix() {
+    void step(float deltaT) {
+        previousPosition = position;
         switch (state) {
             case held:
                 hitTarget = false;
                 if (inputs->handleFire) {
                     position = planePosition;
+                    previousPosition = position; // dropped from the plane: nothing to interpolate
                     speed = planeSpeed;
                     state = falling;
                 } else {
                     position = {0, -2, 0};
                     speed = {0, 0, 0};
-                    return translate(mat4(1), position) * glm::scale(glm::mat4(1), glm::vec3(SCALE));
+                    return;
                 }
             case falling: {
-                speed += inputs->deltaT * externalAccelerations; // external accelerations (doesn't require multiplying by uAxes: already in world coordinates)
+                speed += deltaT * externalAccelerations; // external accelerations (doesn't require multiplying by uAxes: already in world coordinates)
 
                 // friction deceleration and speed limiting are computed in plane space
                 vec3 planeSpeed = inverse(uAxes) * speed; // convert speed from world to plane space
                 // plane speed is reduced by acceleration coordinates times deltaT in the opposite direction of plane speed
-                planeSpeed -= FRICTION * inputs->deltaT * normalize(planeSpeed);
+                planeSpeed -= FRICTION * deltaT * normalize(planeSpeed);
                 // plane speed magnitude (misleadingly named glm::length) is capped at max speed by multiplying the scalar for the direction of plane speed
                 if (glm::length(planeSpeed) > MAX_SPEED) planeSpeed = MAX_SPEED * normalize(planeSpeed);
                 speed = uAxes * planeSpeed; // update world speed converting back from plane speed
 
-                position += speed * inputs->deltaT;
+                position += speed * deltaT;
 
                 if (position.y < 0) { // simple collision detection
                     position.y = 0;
@@ -96,7 +99,7 @@ public:
 
                     state = ground;
                 } else {
-                    return translate(mat4(1), position) * glm::scale(glm::mat4(1), glm::vec3(SCALE));
+                    return;
                 }
             }
             case ground:
@@ -108,10 +111,17 @@ public:
                 } else {
                     cout << "\nTarget missed :(\n";
                 }
-                return translate(mat4(1), position) * glm::scale(glm::mat4(1), glm::vec3(SCALE));
         }
     }
 
+    /**
+     * @param alpha how far the rendered frame is between the previous and the current physics step, in [0, 1]
+     * @return world matrix of the package interpolated between the last two physics steps
+     */
+    mat4 computeWorldMatrix(float alpha) const {
+        return translate(mat4(1), mix(previousPosition, position, alpha)) * glm::scale(glm::mat4(1), glm::vec3(SCALE));
+    }
+
     /**
      * @return plane position in world coordinates
      */
@@ -12,6 +12,7 @@
 #include "Damper.hpp"
 #include "Wing.hpp"
 #include "Logger.hpp"
+#include "Obstacles.hpp"
 
 using namespace glm;
 using namespace std;
@@ -70,6 +71,7 @@ public:
     // collision constants
     constexpr static const float GROUND_COLLISION_ROT = 0.3;
     constexpr static const float COLLISION_DISTANCE = 1.0f;
+    constexpr static const float COLLISION_SKIN = 0.01f; // the plane is stopped this far before the contact point
     constexpr static const vec3 MESH_COLLISION_BOUNCE = {-0.9, -1.1, -0.9};
     constexpr static const int SUCCESSIVE_MESH_COLLISIONS = 3;
     constexpr static const int PREV_COLLISIONS_SIZE = 10;
@@ -79,6 +81,9 @@ private:
     vec3 position;
     vec3 initialPosition;
     quat rotation;
+    // state at the previous physics step, interpolated with the current one for rendering
+    vec3 previousPosition;
+    quat previousRotation;
     vec3 speed = INITIAL_SPEED;
     mat3 uAxes;
     const Wing& wing;
@@ -95,30 +100,27 @@ private:
     Damper<float> pitchDamper = Damper<float>(ROT_DAMPING, 0, upper, lower);
     Damper<float> throttleDamper = Damper<float>(THROTTLE_DAMPING, 0, upper, lower);
 
-    // list of vertices of models for which we want collision detection
-    const vector<vec3>& verticesToAvoid;
+    // models for which we want collision detection
+    const Obstacles& obstacles;
 
     Collision collision = NONE;
     vector<Collision> prevCollisions;
 
     /**
      * Collision detection algorithm
-     * Simple technique based on plane position and on the vertices of the models that the plane has to avoid: find the vertex with
-     * the highest y value among those with x and y "close" to the plane. If its y is higher than the plane's, it means a collision
-     * has happened.
-     * The big simplification here is that if the model has very few vertices very far apart (e.g. a simple big cube) a collision would
-     * not be detected if the plane collided in the middle of the cube's face, because no vertex would be found close to the plane.
+     * The plane is approximated by a sphere of radius COLLISION_DISTANCE: a collision with a mesh happens when the sphere
+     * touches the obstacles or is inside one of them. The sphere is swept along the whole movement of the frame, so fast
+     * movements or long frames can't go through thin obstacles and the result doesn't depend on the frame rate.
+     * How the sweep is carried out (and how exact it is) depends on the Obstacles implementation the plane was given.
      */
     void detectCollisions() {
-        glm::vec3 highestPoint = {0.0, -1.0, 0.0};
-        for (auto p : verticesToAvoid) {
-            // this condition checks a vertical cylinder of points of radius COLLISION_DISTANCE and takes the point inside
-            // the cylinder with the highest y value
-            if (glm::length(vec2(p.x, p.z) - vec2(position.x, position.z)) < COLLISION_DISTANCE && p.y > highestPoint.y) {
-                highestPoint = p;
-            }
-        }
-        if (highestPoint.y > position.y) { // mesh collisions have priority over ground collisions (in case both are happening)
+        float impact = obstacles.timeOfImpact(previousPosition, position, COLLISION_DISTANCE);
+        if (impact != Obstacles::NO_IMPACT) { // mesh collisions have priority over ground collisions (in case both are happening)
+            // stop the plane just before the contact point
+            vec3 movement = position - previousPosition;
+            float length = glm::length(movement);
+            float backOff = length > 0 ? COLLISION_SKIN / length : 0;
+            position = previousPosition + movement * std::max(0.0f, impact - backOff);
             collision = MESH;
             return;
         }
@@ -184,6 +186,7 @@ private:
                          speed.z * MESH_COLLISION_BOUNCE.z};
                 if(countPrevMeshCollisions() > SUCCESSIVE_MESH_COLLISIONS) {
                     position = {0, 0, 0};
+                    previousPosition = position; // teleport: nothing to interpolate
                     speed = {0, 0, 0};
                 }
                 //cout << "COLLISION WITH BUILDING DETECTED\n";
@@ -222,62 +225,62 @@ private:
     }
 
 public:
-    Plane(const Wing& wing, const vector<vec3>& collisionDetectionVertices = {}, vec3 initialPosition = vec3(0),
+    Plane(const Wing& wing, const Obstacles& obstacles, vec3 initialPosition = vec3(0),
           quat initialRotation = identity<quat>()) :
             wing(wing),
             position(initialPosition),
             initialPosition(initialPosition),
             rotation(initialRotation),
-            verticesToAvoid(collisionDetectionVertices) {}
+            previousPosition(initialPosition),
+            previousRotation(initialRotation),
+            obstacles(obstacles) {}
 
     void updateInputs(UserInputs* userInputs) {
         inputs = userInputs;
     }
 
     /**
-     * computes the world matrix for a new frame using the command inputs and stores it internally for other functions
-     * @return updated world matrix
+     * advances the simulation of the plane by a physics step using the command inputs
+     * @param deltaT duration of the step: a fixed value keeps the flight and the collisions independent of the frame rate
      */
-    mat4 computeWorldMatrix() {
+    void step(float deltaT) {
+        previousPosition = position;
+        previousRotation = rotation;
+
         controls.map(*inputs);
         updateUAxes();
 
         float wingLift = wing.computeLift((inverse(uAxes) * speed).z);
 
         // from glm::rotate documentation: returns and takes as input either rotation MATRIX or rotation QUATERNION
-        float rollDamp = rollDamper.damp(controls.roll /* - computeAutoRollRotation()*/, inputs->deltaT);
-        float yawDamp = yawDamper.damp(controls.yaw, inputs->deltaT);
-        float pitchDamp = pitchDamper.damp(controls.pitch, inputs->deltaT);
-        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.x * wingLift * rollDamp * inputs->deltaT, vec3(1, 0, 0));
-        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.y * wingLift * yawDamp * inputs->deltaT, vec3(0, 1, 0));
-        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.z * wingLift * pitchDamp * inputs->deltaT, vec3(0, 0, 1));
+        float rollDamp = rollDamper.damp(controls.roll /* - computeAutoRollRotation()*/, deltaT);
+        float yawDamp = yawDamper.damp(controls.yaw, deltaT);
+        float pitchDamp = pitchDamper.damp(controls.pitch, deltaT);
+        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.x * wingLift * rollDamp * deltaT, vec3(1, 0, 0));
+        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.y * wingLift * yawDamp * deltaT, vec3(0, 1, 0));
+        rotation = rotate(rotation, CONTROL_SURFACES_ROT_ACCELERATION.z * wingLift * pitchDamp * deltaT, vec3(0, 0, 1));
 
-        speed += inputs->deltaT * EXTERNAL_ACCELERATIONS; // external accelerations (doesn't require multiplying by uAxes: already in world coordinates)
+        speed += deltaT * EXTERNAL_ACCELERATIONS; // external accelerations (doesn't require multiplying by uAxes: already in world coordinates)
 
         // friction deceleration and speed limiting are computed in plane space
         vec3 planeSpeed = inverse(uAxes) * speed; // convert speed from world to plane space
         // engine and wing accelerations
-        planeSpeed += inputs->deltaT * (
-                vec3(0.0f, 0.0f, throttleDamper.damp(controls.speed, inputs->deltaT) * ENGINE_ACCELERATION)
+        planeSpeed += deltaT * (
+                vec3(0.0f, 0.0f, throttleDamper.damp(controls.speed, deltaT) * ENGINE_ACCELERATION)
                 // acceleration due to plane wings generating lift linear with speed
                 + vec3(0.0, std::cos(WING_LIFT_ANGLE) * wingLift, - WING_INEFFICIENCY * std::sin(WING_LIFT_ANGLE) * wingLift)
         );
         // plane speed is reduced by dynamic friction in the opposite direction of plane speed
-        planeSpeed -= inputs->deltaT * vec3{FRICTION.x * planeSpeed.x, FRICTION.y * planeSpeed.y, FRICTION.z * planeSpeed.z};
+        planeSpeed -= deltaT * vec3{FRICTION.x * planeSpeed.x, FRICTION.y * planeSpeed.y, FRICTION.z * planeSpeed.z};
         // plane speed magnitude (misleadingly named glm::length) is capped at max speed by multiplying the scalar for the direction of plane speed
         if (glm::length(planeSpeed) > MAX_SPEED) planeSpeed = MAX_SPEED * normalize(planeSpeed);
         speed = uAxes * planeSpeed; // update world speed converting back from plane speed
 
-        position += speed * inputs->deltaT;
+        position += speed * deltaT;
 
         detectCollisions();
         reactToCollision();
 
-        mat4 world =
-                translate(mat4(1), position) *
-                toMat4(rotation) *
-                scale(mat4(1), vec3(PLANE_SCALE)); //additional transform to scale down the character in character space
-
         static Logger logger(cout);
         if (PRINT_DEBUG) {
             map<string, vec3> debugInfo;
@@ -288,14 +291,24 @@ public:
 
             logger.log<vec3>(debugInfo, &vecToString, 21);
         }
+    }
 
-        return world;
+    /**
+     * @param alpha how far the rendered frame is between the previous and the current physics step, in [0, 1]
+     * @return world matrix of the plane interpolated between the last two physics steps
+     */
+    mat4 computeWorldMatrix(float alpha) const {
+        return translate(mat4(1), mix(previousPosition, position, alpha)) *
+               toMat4(slerp(previousRotation, rotation, alpha)) *
+               scale(mat4(1), vec3(PLANE_SCALE)); //additional transform to scale down the character in character space
     }
 
     void resetState() {
         speed = INITIAL_SPEED;
         position = initialPosition;
         rotation = identity<quat>();
+        previousPosition = position;
+        previousRotation = rotation;
         prevCollisions.clear();
         rollDamper.reset();
         pitchDamper.reset();
@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <fstream>
 #include <array>
+#include <map>
+#include <sstream>
+#include <deque>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -27,21 +30,16 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#define TINYGLTF_NOEXCEPTION
-#define JSON_NOEXCEPTION
-#define TINYGLTF_NO_INCLUDE_STB_IMAGE
-#include <tiny_gltf.h>
+#include "GLTFDecoder.hpp"
+#include "Frustum.hpp"
+#include "TextureBaking.hpp"
+#include "KTX2.hpp"
+#include "MeshCache.hpp"
+#include "TaskLog.hpp"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-#include <plusaes.hpp>
-
-#define SINFL_IMPLEMENTATION
-#include <sinfl.h>
-
 
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
@@ -57,6 +55,8 @@ const std::vector<const char*> validationLayers = {
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// a family with transfers but neither graphics nor compute, usually a DMA engine: optional
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete() {
 		return graphicsFamily.has_value() &&
@@ -192,6 +192,7 @@ struct VertexDescriptor {
 	VertexComponent UV;
 	VertexComponent Color;
 	VertexComponent Tangent;
+	uint32_t vertexBinding; // the one read from the models, the others are per instance
 
 	std::vector<VertexBindingDescriptorElement> Bindings;
 	std::vector<VertexDescriptorElement> Layout;
@@ -206,28 +207,118 @@ struct VertexDescriptor {
 
 enum ModelType {OBJ, GLTF, MGCG};
 
+// Where vertex and index buffers are allocated. DEVICE_LOCAL buffers are filled once, by a staged copy of the
+// uploads, and are the fastest to draw on discrete GPUs. HOST_VISIBLE buffers are written directly by the CPU, for
+// meshes whose vertices are written again while the game runs.
+enum BufferMemory {DEVICE_LOCAL, HOST_VISIBLE};
+
 template <class Vert>
 class Model {
 	BaseProject *BP;
 	
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
 	VertexDescriptor *VD;
+	uint64_t uploadTicket = 0;
 
 	public:
 	std::vector<Vert> vertices{};
 	std::vector<uint32_t> indices{};
+	BoundingVolume bounds; // in model coordinates, empty if the vertices have no 3D position
+	BufferMemory memory = DEVICE_LOCAL; // of the buffers, chosen before they are created
 	void loadModelOBJ(std::string file);
 	void loadModelGLTF(std::string file, bool encoded);
 	void createIndexBuffer();
 	void createVertexBuffer();
+	void computeBounds();
+	uint64_t layoutHash() const;
 
+	// load and loadMesh only fill vertices, indices and bounds, for models drawn from a GeometryPool:
+	// init and initMesh also create the buffers of the model
+	void load(BaseProject *bp, VertexDescriptor *VD, std::string file, ModelType MT);
+	void loadMesh(BaseProject *bp, VertexDescriptor *VD);
 	void init(BaseProject *bp, VertexDescriptor *VD, std::string file, ModelType MT);
 	void initMesh(BaseProject *bp, VertexDescriptor *VD);
 	void cleanup();
   	void bind(VkCommandBuffer commandBuffer);
+	// false until the upload of DEVICE_LOCAL buffers created while the game runs can be drawn
+	bool isReady() const;
+};
+
+// Position of a model inside a GeometryPool: the arguments of its indexed draws
+struct GeometryRange {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+};
+
+// Vertex and index buffers shared by all the models of a vertex format: the models are added
+// after they are loaded, the buffers are created once for all of them, and a single bind
+// serves every draw of the pool.
+template <class Vert>
+class GeometryPool {
+	BaseProject *BP;
+	
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+	std::vector<Vert> vertices{};
+	std::vector<uint32_t> indices{};
+	uint64_t uploadTicket = 0;
+
+	public:
+	GeometryRange add(const Model<Vert> &model);
+	GeometryRange addLevel(const GeometryRange &base, const std::vector<uint32_t> &levelIndices);
+	void create(BaseProject *bp, BufferMemory memory = DEVICE_LOCAL);
+	void cleanup();
+  	void bind(VkCommandBuffer commandBuffer);
+  	void draw(VkCommandBuffer commandBuffer, const GeometryRange &range,
+  			  uint32_t instances = 1, uint32_t firstInstance = 0);
+	// false until the upload of DEVICE_LOCAL buffers created while the game runs can be drawn, as for Model
+	bool isReady() const;
+};
+
+// Indexed draws chosen at every frame (e.g. after culling), written in a host coherent buffer per
+// swap chain image and issued with a single vkCmdDrawIndexedIndirect. Devices without multi draw
+// indirect (or without firstInstance in indirect draws) get the same draws one by one.
+struct IndirectDrawBuffer {
+	BaseProject *BP;
+	uint32_t capacity;
+
+	std::vector<VkBuffer> buffers;
+	std::vector<VkDeviceMemory> buffersMemory;
+	std::vector<VkDrawIndexedIndirectCommand *> commands;
+	std::vector<uint32_t> counts;
+
+	void init(BaseProject *bp, uint32_t maxDraws);
+	void clear(int currentImage);
+	void add(int currentImage, const GeometryRange &range, uint32_t instances, uint32_t firstInstance);
+	void draw(VkCommandBuffer commandBuffer, int currentImage);
+	void cleanup();
+};
+
+// Per instance attributes (e.g. a transform) read by a VK_VERTEX_INPUT_RATE_INSTANCE binding of
+// the vertex descriptor: instances are placed anywhere, not only where gl_InstanceIndex can compute.
+// Written in a host coherent buffer per swap chain image, so they can change at every frame; a draw
+// picks its instances with firstInstance, the index returned when the first of them was added.
+template <class Inst>
+struct InstanceBuffer {
+	BaseProject *BP;
+	uint32_t capacity;
+
+	std::vector<VkBuffer> buffers;
+	std::vector<VkDeviceMemory> buffersMemory;
+	std::vector<Inst *> instances;
+	std::vector<uint32_t> counts;
+
+	void init(BaseProject *bp, uint32_t maxInstances);
+	void clear(int currentImage);
+	uint32_t add(int currentImage, const Inst &instance);
+	void bind(VkCommandBuffer commandBuffer, int currentImage, uint32_t binding);
+	void cleanup();
 };
 
 struct Texture {
@@ -239,8 +330,16 @@ struct Texture {
 	VkSampler textureSampler;
 	int imgs;
 	static const int maxImgs = 6;
+	// what load decodes, on any thread, and create uploads and releases, on the thread recording the commands
+	RGBAImage decodedImage;
+	KTX2Texture bakedImage;
+	VkFormat format;
+	uint32_t maxMipLevels;
+	VkSamplerAddressMode addressMode;
 	
 	void createTextureImage(const char *const files[], VkFormat Fmt);
+	void uploadTextureImage(const unsigned char *const pixels[], int texWidth, int texHeight, VkFormat Fmt);
+	void uploadCompressedImage(const KTX2Texture &baked);
 	void createTextureImageView(VkFormat Fmt);
 	void createTextureSampler(VkFilter magFilter,
 							 VkFilter minFilter,
@@ -252,8 +351,34 @@ struct Texture {
 							 float maxLod
 							);
 
+	// load, loadPixels and loadBaked only touch memory and files, so textures can be decoded in parallel:
+	// create makes the Vulkan image from what they loaded. init does both
+	void load(BaseProject *bp, const char * file, VkFormat Fmt);
+	void loadPixels(BaseProject *bp, RGBAImage pixels, uint32_t maxLevels, VkFormat Fmt,
+					VkSamplerAddressMode samplerAddressMode);
+	void loadBaked(BaseProject *bp, KTX2Texture baked, VkSamplerAddressMode samplerAddressMode);
+	void create(bool initSampler);
 	void init(BaseProject *bp, const char * file, VkFormat Fmt, bool initSampler);
 	void initCubic(BaseProject *bp, const char * files[6]);
+	// the KTX2 file texture-baker writes next to an image, used instead of the image when the device supports BC
+	static std::string bakedFile(const std::string &file);
+	static bool canUseBaked(BaseProject *bp, const std::string &baked, VkFormat Fmt);
+	void cleanup();
+};
+
+// Several images packed side by side in a single texture (see AtlasPacking), so that the draws sampling any of them
+// share a descriptor set and can be merged in one instanced draw. The atlas is packed at startup, unless texture-baker
+// has baked it already with the same images.
+struct TextureAtlas {
+	Texture texture;
+	std::vector<glm::vec4> regions; // of each image in uv coordinates: offset in xy, size in zw
+
+	// load is the CPU side of init and create the Vulkan one, as for Texture
+	void load(BaseProject *bp, const std::vector<std::string> &files, const std::string &baked, VkFormat Fmt);
+	void create();
+	void init(BaseProject *bp, const std::vector<std::string> &files, const std::string &baked, VkFormat Fmt);
+	// uv of the image in the atlas, from a uv in [0, 1] of the image
+	glm::vec4 region(int image) const { return regions[image]; }
 	void cleanup();
 };
 
@@ -272,6 +397,108 @@ struct DescriptorSetLayout {
 	void cleanup();
 };
 
+// Object tested by GpuCulling: world bounds and the draw to emit when it is visible,
+// in the std430 layout of shaders/Cull.comp
+struct CullObject {
+	glm::vec4 sphere; // center, radius
+	glm::vec4 boxMin;
+	glm::vec4 boxMax;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+	uint32_t instanceCount; // 0 for an unused slot
+	uint32_t list;
+	uint32_t listStart; // set by GpuCulling
+	uint32_t listCapacity;
+};
+
+// uniform of shaders/Cull.comp, written by GpuCulling::record at every frame
+struct CullFrame {
+	static constexpr uint32_t groupSize = 64; // local_size_x of the shader
+	alignas(16) glm::vec4 planes[6];
+	alignas(16) glm::vec4 eye; // w: culling distance, 0 for the frustum only
+	alignas(16) glm::mat4 pyramidViewProjection; // of the frame reduced in the depth pyramid
+	alignas(8) glm::vec2 pyramidSize;
+	uint32_t objectCount;
+	uint32_t occlusion; // 1 when the depth pyramid holds a frame
+};
+
+// counted by shaders/Cull.comp, read back when the swap chain image is recorded again
+struct CullStatistics {
+	uint32_t tested;
+	uint32_t frustumCulled; // outside the frustum or too far
+	uint32_t occluded; // hidden in the depth pyramid
+};
+
+// Hierarchical depth (Hi-Z) of the last frame drawn: level 0 is the depth attachment reduced to a
+// power of two, every level keeps the farthest depth of the 2x2 texels under it. Built by
+// shaders/HiZ.comp after the render pass, GpuCulling tests the bounds of the objects against it.
+// One for all the swap chain images, as the depth attachment it is built from.
+struct DepthPyramid {
+	static constexpr uint32_t groupSize = 8; // local_size_x and local_size_y of the shader
+
+	BaseProject *BP;
+	bool supported; // the depth attachment can be sampled: otherwise the pyramid is never built
+	bool valid; // a frame was reduced since init
+	glm::mat4 viewProjection; // of the frame reduced
+	uint32_t width, height, levels;
+
+	VkImage image;
+	VkDeviceMemory imageMemory;
+	VkImageView view; // all the levels, for the culling
+	std::vector<VkImageView> levelViews; // written one at a time
+	VkSampler sampler;
+
+	DescriptorSetLayout DSL;
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorSet> descriptorSets; // one per level
+	VkPipelineLayout pipelineLayout;
+	VkPipeline depthPipeline, reducePipeline; // level 0 from the depth, the others from the level above
+
+	void init(BaseProject *bp, const std::string &depthShader, const std::string &reduceShader);
+	void build(VkCommandBuffer commandBuffer, const glm::mat4 &frameViewProjection);
+	void cleanup();
+};
+
+// Frustum, distance and occlusion culling on the GPU. Before the render pass a compute shader
+// tests every object and appends the draws of the visible ones to their draw list, counting them:
+// each list is then drawn with vkCmdDrawIndexedIndirectCount, without the CPU knowing what is visible.
+// The objects are in a host coherent buffer per swap chain image, written only when they move.
+// Occlusion is tested against the depth pyramid of the last frame, reprojected with its view projection:
+// an object that just came out from behind another one appears one frame late.
+struct GpuCulling {
+	BaseProject *BP;
+	DepthPyramid *pyramid;
+	uint32_t objectCapacity;
+	std::vector<uint32_t> listCapacities;
+	std::vector<uint32_t> listStarts;
+
+	DescriptorSetLayout DSL;
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorSet> descriptorSets;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+
+	std::vector<VkBuffer> objectBuffers, commandBuffers, countBuffers, frameBuffers, statisticsBuffers;
+	std::vector<VkDeviceMemory> objectBuffersMemory, commandBuffersMemory, countBuffersMemory,
+								frameBuffersMemory, statisticsBuffersMemory;
+	std::vector<CullObject *> objects;
+	std::vector<CullFrame *> frames;
+	std::vector<CullStatistics *> counters;
+	CullStatistics statistics{}; // of the last frame of the last image recorded
+
+	void init(BaseProject *bp, const std::string &shader, DepthPyramid &depthPyramid,
+			  uint32_t maxObjects, std::vector<uint32_t> maxDrawsPerList);
+	static CullObject object(const GeometryRange &range, const BoundingVolume &worldBounds,
+							 uint32_t instances, uint32_t firstInstance, uint32_t list);
+	void setObject(int currentImage, uint32_t index, CullObject object);
+	void record(VkCommandBuffer commandBuffer, int currentImage,
+				const std::array<glm::vec4, 6> &planes, glm::vec3 eye, float maxDistance);
+	void draw(VkCommandBuffer commandBuffer, int currentImage, uint32_t list);
+	void cleanup();
+};
+
 struct Pipeline {
 	BaseProject *BP;
 	VkPipeline graphicsPipeline;
@@ -285,14 +512,20 @@ struct Pipeline {
 	VkPolygonMode polyModel;
  	VkCullModeFlagBits CM;
  	bool transp;
+ 	bool depthWrite;
 	
 	VertexDescriptor *VD;
+	std::vector<VkPushConstantRange> pushConstantRanges;
   	
   	void init(BaseProject *bp, VertexDescriptor *vd,
 			  const std::string& VertShader, const std::string& FragShader,
   			  std::vector<DescriptorSetLayout *> D);
   	void setAdvancedFeatures(VkCompareOp _compareOp, VkPolygonMode _polyModel,
  						VkCullModeFlagBits _CM, bool _transp);
+  	void setDepthWrite(bool _depthWrite);
+  	void addPushConstantRange(VkShaderStageFlags stages, uint32_t offset, uint32_t size);
+  	void push(VkCommandBuffer commandBuffer, VkShaderStageFlags stages, uint32_t offset,
+  			  uint32_t size, const void *values);
   	void create();
   	void destroy();
   	void bind(VkCommandBuffer commandBuffer);
@@ -301,29 +534,139 @@ struct Pipeline {
 	void cleanup();
 };
 
-enum DescriptorSetElementType {UNIFORM, TEXTURE};
+// UNIFORM_DYNAMIC holds count blocks of the same type, one per object drawn with the set:
+// the block used by a draw is chosen when binding the set, with a dynamic offset
+enum DescriptorSetElementType {UNIFORM, TEXTURE, UNIFORM_DYNAMIC};
 
 struct DescriptorSetElement {
 	int binding;
 	DescriptorSetElementType type;
 	int size;
 	Texture *tex;
+	int count = 1;
+};
+
+// Position of a uniform block inside the UniformArena: the same in the buffer of every swap chain image
+struct UniformAllocation {
+	uint32_t block;
+	VkDeviceSize offset;
+};
+
+// Host coherent memory holding the uniform blocks of all the descriptor sets.
+// Memory is taken in big blocks, each with a buffer per swap chain image that stays mapped,
+// and split among the uniform blocks at the alignment the device requires:
+// writing a uniform is a memcpy, and thousands of objects need only a few Vulkan allocations.
+// Allocations are never freed one by one: the whole arena is released with the swap chain,
+// together with the descriptor sets that use it.
+struct UniformArena {
+	BaseProject *BP;
+	static constexpr VkDeviceSize blockSize = 256 * 1024;
+	VkDeviceSize alignment = 256;
+
+	std::vector<std::vector<VkBuffer>> buffers;
+	std::vector<std::vector<VkDeviceMemory>> buffersMemory;
+	std::vector<std::vector<char *>> mapped;
+	VkDeviceSize used = 0;
+
+	void init(BaseProject *bp);
+	void addBlock(VkDeviceSize size);
+	UniformAllocation allocate(VkDeviceSize size);
+	VkBuffer buffer(UniformAllocation allocation, int currentImage);
+	void *pointer(UniformAllocation allocation, int currentImage);
+	void cleanup();
+};
+
+// Data of a region of an image, copied by UploadManager::uploadImage: the bufferOffset of copy is
+// where the data lands in the staging memory, set by the manager.
+struct ImageUploadRegion {
+	const void *data;
+	VkDeviceSize size;
+	VkBufferImageCopy copy;
+};
+
+// Copies of data to device local buffers and images through host visible staging memory, recorded
+// in a batch and submitted together. Devices with a transfer only queue family copy there, without
+// holding the graphics queue: when the copies of a batch are complete, update releases them to the
+// graphics queue (which also blits the mip levels, the transfer queue can't), so the frames keep
+// going while the data streams in. Every upload returns the ticket of its batch: what it uploaded
+// can be drawn once the ticket is ready. Only used from the thread that submits the frames.
+struct UploadManager {
+	BaseProject *BP;
+	static constexpr VkDeviceSize stagingBlockSize = 32 * 1024 * 1024;
+
+	struct StagingBlock {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		VkDeviceSize used;
+		char *mapped;
+	};
+	struct Batch {
+		uint64_t ticket;
+		VkCommandBuffer transferCommands;
+		VkCommandBuffer graphicsCommands; // the same as transferCommands without a transfer queue
+		VkFence transferred = VK_NULL_HANDLE;
+		VkFence completed = VK_NULL_HANDLE;
+		bool released = false;           // graphicsCommands submitted
+		std::vector<StagingBlock> staging;
+	};
+
+	uint32_t graphicsFamily;
+	uint32_t transferFamily;
+	VkQueue transferQueue;
+	VkCommandPool graphicsPool;
+	VkCommandPool transferPool;
+	Batch recording;
+	bool isRecording = false;
+	std::deque<Batch> submitted;
+	std::vector<StagingBlock> freeStaging;
+	uint64_t nextTicket = 1;
+	uint64_t readyTicket = 0;
+	uint64_t completedTicket = 0;
+
+	void init(BaseProject *bp, uint32_t graphicsQueueFamily, uint32_t transferQueueFamily);
+	bool dedicatedTransfer() const { return transferFamily != graphicsFamily; }
+	// dstStage and dstAccess: how the buffer is used after the upload, e.g. vertex input
+	uint64_t uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+						  VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	// the image is left in SHADER_READ_ONLY for the fragment shader; with generateMipmaps only level 0
+	// is uploaded, the others are blitted from it
+	uint64_t uploadImage(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels,
+						 uint32_t layers, const std::vector<ImageUploadRegion> &regions, bool generateMipmaps);
+	// submits the batch being recorded: returns its ticket, 0 if nothing was recorded
+	uint64_t submit();
+	// releases to the graphics queue the batches whose copies are complete and recycles the staging
+	// memory of the batches done: never waits
+	void update();
+	bool isReady(uint64_t ticket) const { return ticket <= readyTicket; }
+	bool isComplete(uint64_t ticket) const { return ticket <= completedTicket; }
+	// waits for the copies of the ticket, submitting it first if needed, and releases them
+	void waitReady(uint64_t ticket);
+	void cleanup();
+
+	void begin();
+	VkBuffer stage(const void *data, VkDeviceSize size, VkDeviceSize &offset);
+	StagingBlock createStagingBlock(VkDeviceSize size);
+	void destroyStagingBlock(StagingBlock &block);
+	void release(Batch &batch);
+	void recycle(Batch &batch);
 };
 
 struct DescriptorSet {
 	BaseProject *BP;
 
-	std::vector<std::vector<VkBuffer>> uniformBuffers;
-	std::vector<std::vector<VkDeviceMemory>> uniformBuffersMemory;
+	std::vector<UniformAllocation> uniforms;
+	std::vector<VkDeviceSize> dynamicStrides; // distance between the blocks of UNIFORM_DYNAMIC elements, 0 for the others
 	std::vector<VkDescriptorSet> descriptorSets;
-	
-	std::vector<bool> toFree;
+	static const int maxDynamicUniforms = 8;
 
 	void init(BaseProject *bp, DescriptorSetLayout *L,
 		std::vector<DescriptorSetElement> E);
 	void cleanup();
   	void bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage);
+  	void bindDynamic(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage, int index);
   	void map(int currentImage, void *src, int size, int slot);
+  	void mapDynamic(int currentImage, void *src, int size, int slot, int index);
 };
 
 
@@ -332,9 +675,17 @@ class BaseProject {
 	friend class VertexDescriptor;
 	template <class Vert> friend class Model;
 	friend class Texture;
+	friend class TextureAtlas;
 	friend class Pipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
+	friend class UniformArena;
+	friend class UploadManager;
+	template <class Vert> friend class GeometryPool;
+	template <class Inst> friend struct InstanceBuffer;
+	friend class IndirectDrawBuffer;
+	friend class DepthPyramid;
+	friend class GpuCulling;
 public:
 	virtual void setWindowParameters() = 0;
     void run() {
@@ -423,6 +774,7 @@ protected:
 	std::string windowTitle;
 	VkClearColorValue initialBackgroundColor;
 	int uniformBlocksInPool;
+	int dynamicUniformBlocksInPool = 0;
 	int texturesInPool;
 	int setsInPool;
 
@@ -435,6 +787,8 @@ protected:
     VkQueue graphicsQueue;
     VkQueue presentQueue;
 	VkCommandPool commandPool;
+	// one pool per swap chain image, reset as a whole before the frame of that image is recorded
+	std::vector<VkCommandPool> frameCommandPools;
 	std::vector<VkCommandBuffer> commandBuffers;
 
     VkSwapchainKHR swapChain;
@@ -446,6 +800,19 @@ protected:
 	VkRenderPass renderPass;
 	
  	VkDescriptorPool descriptorPool;
+	UniformArena uniformArena;
+	// staged copies to the device local buffers and images, on the transfer queue if there is one
+	UploadManager uploads;
+	// keep the uploads on the graphics queue even when there is a transfer family, as on the devices without one
+	bool uploadsOnGraphicsQueue = false;
+	bool indirectDrawSupport = false; // multiDrawIndirect and drawIndirectFirstInstance
+	// VK_KHR_draw_indirect_count, with compute on the graphics queue: draws can be culled by GpuCulling
+	bool gpuCullingSupport = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+	// the depth attachment can be sampled at msaaSamples: DepthPyramid can reduce it
+	bool depthSamplingSupport = false;
+	// BC1-7 textures can be sampled: Texture loads the baked KTX2 files instead of decoding the images
+	bool textureCompressionBCSupport = false;
 
 	VkDebugUtilsMessengerEXT debugMessenger;
 	
@@ -499,16 +866,20 @@ protected:
 		createSurface();				
 		pickPhysicalDevice();			
 		createLogicalDevice();			
+		uniformArena.init(this);
 		createSwapChain();				
 		createImageViews();				
 		createRenderPass();			
 		createCommandPool();			
+		createUploadManager();
 		createColorResources();
 		createDepthResources();			
 		createFramebuffers();			
 		createDescriptorPool();			
 
 		localInit();
+		// what localInit uploaded is drawn from the first frame
+		uploads.waitReady(uploads.submit());
 		pipelinesAndDescriptorSetsInit();
 
 		createCommandBuffers();			
@@ -740,6 +1111,9 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			bool suitable = isDeviceSuitable(device, devRep);
 			if (suitable) {
 				physicalDevice = device;
+				if(checkIfItHasDeviceExtension(device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+					deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				}
 				msaaSamples = getMaxUsableSampleCount();
 				std::cout << "\n\nMaximum samples for anti-aliasing: " << msaaSamples << "\n\n\n";
 				break;
@@ -791,18 +1165,25 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 								
 		int i=0;
 		for (const auto& queueFamily : queueFamilies) {
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphicsFamily = i;
+			if (!indices.isComplete()) {
+				if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+					indices.graphicsFamily = i;
+				}
+					
+				VkBool32 presentSupport = false;
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+													 &presentSupport);
+				if (presentSupport) {
+				 	indices.presentFamily = i;
+				}
 			}
-				
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
-												 &presentSupport);
-			if (presentSupport) {
-			 	indices.presentFamily = i;
+
+			if (!indices.transferFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+				!(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = i;
 			}
 
-			if (indices.isComplete()) {
+			if (indices.isComplete() && indices.transferFamily.has_value()) {
 				break;
 			}			
 			i++;
@@ -884,6 +1265,9 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies =
 				{indices.graphicsFamily.value(), indices.presentFamily.value()};
+		if (indices.transferFamily.has_value()) {
+			uniqueQueueFamilies.insert(indices.transferFamily.value());
+		}
 		
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -895,9 +1279,18 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 		
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		indirectDrawSupport = supportedFeatures.multiDrawIndirect &&
+							  supportedFeatures.drawIndirectFirstInstance;
+		textureCompressionBCSupport = supportedFeatures.textureCompressionBC;
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.sampleRateShading = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = indirectDrawSupport ? VK_TRUE : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = indirectDrawSupport ? VK_TRUE : VK_FALSE;
+		deviceFeatures.textureCompressionBC = textureCompressionBCSupport ? VK_TRUE : VK_FALSE;
 		
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -924,6 +1317,22 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+		// an extension of the Vulkan 1.0 instance created here: its command has to be loaded
+		if (std::find_if(deviceExtensions.begin(), deviceExtensions.end(), [](const char *ext) {
+				return strcmp(ext, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0; }) != deviceExtensions.end()) {
+			cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+					vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+		}
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+		bool graphicsHasCompute =
+				queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT;
+		gpuCullingSupport = indirectDrawSupport && graphicsHasCompute &&
+							cmdDrawIndexedIndirectCount != nullptr;
+		std::cout << "GPU culling: " << (gpuCullingSupport ? "supported" : "not supported") << "\n";
 	}
 	
 	void createSwapChain() {
@@ -1063,6 +1472,36 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		}
 		return imageView;
 	}
+
+	VkPipeline createComputePipeline(const std::string &shader, VkPipelineLayout layout) {
+		auto code = readFile(shader);
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = code.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		VkShaderModule shaderModule;
+		VkResult result = vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule);
+		if (result != VK_SUCCESS) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to create shader module!");
+		}
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+		VkPipeline pipeline;
+		result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+		vkDestroyShaderModule(device, shaderModule, nullptr);
+		if (result != VK_SUCCESS) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to create compute pipeline!");
+		}
+		return pipeline;
+	}
 	
     void createRenderPass() {
 		VkAttachmentDescription colorAttachmentResolve{};
@@ -1084,7 +1523,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		depthAttachment.format = findDepthFormat();
 		depthAttachment.samples = msaaSamples;
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // reduced in the depth pyramid
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1192,6 +1631,14 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		}
 	}
 
+	void createUploadManager() {
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+		uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+		uint32_t transferFamily = uploadsOnGraphicsQueue ? graphicsFamily :
+								  queueFamilyIndices.transferFamily.value_or(graphicsFamily);
+		uploads.init(this, graphicsFamily, transferFamily);
+	}
+
 	void createColorResources() {
 		VkFormat colorFormat = swapChainImageFormat;
 		createImage(swapChainExtent.width, swapChainExtent.height, 1, 1,
@@ -1207,10 +1654,20 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 	void createDepthResources() {
 		VkFormat depthFormat = findDepthFormat();
+
+		// sampled after the render pass, to build the depth pyramid of the occlusion culling
+		VkFormatProperties depthProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &depthProperties);
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		depthSamplingSupport =
+				(depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+				(deviceProperties.limits.sampledImageDepthSampleCounts & msaaSamples);
 		
 		createImage(swapChainExtent.width, swapChainExtent.height, 1, 1,
 					msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, 
+					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+					(depthSamplingSupport ? VK_IMAGE_USAGE_SAMPLED_BIT : 0), 0, 
 					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 					depthImage, depthImageMemory);
 		depthImageView = createImageView(depthImage, depthFormat,
@@ -1311,7 +1768,14 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		}
 
 		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-		
+		recordMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels, layerCount);
+		endSingleTimeCommands(commandBuffer);
+	}
+
+	// blits each level from the previous one, all in TRANSFER_DST: they end in SHADER_READ_ONLY
+	void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image,
+					   int32_t texWidth, int32_t texHeight,
+					   uint32_t mipLevels, int layerCount) {
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
@@ -1382,8 +1846,6 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 							 0, nullptr, 0, nullptr,
 							 1, &barrier);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 	
 	void transitionImageLayout(VkImage image, VkFormat format,
@@ -1429,6 +1891,12 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 			sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 			destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		} else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+				   newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		} else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && 
 				   newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 			barrier.srcAccessMask = 0;
@@ -1466,6 +1934,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		endSingleTimeCommands(commandBuffer);
 	}
+
 	
 	VkCommandBuffer beginSingleTimeCommands() { 
 		VkCommandBufferAllocateInfo allocInfo{};
@@ -1534,6 +2003,27 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		vkBindBufferMemory(device, buffer, bufferMemory, 0);	
 	}
 	
+	// a vertex or index buffer holding size bytes of data: returns the ticket of its upload, 0 for
+	// HOST_VISIBLE buffers, which are written right away
+	uint64_t createFilledBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage,
+								BufferMemory memory, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+		if (memory == HOST_VISIBLE) {
+			createBuffer(size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 buffer, bufferMemory);
+			void* mapped;
+			vkMapMemory(device, bufferMemory, 0, size, 0, &mapped);
+			memcpy(mapped, data, (size_t) size);
+			vkUnmapMemory(device, bufferMemory);
+			return 0;
+		}
+		createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					 buffer, bufferMemory);
+		return uploads.uploadBuffer(buffer, 0, data, size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+									(usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ? VK_ACCESS_INDEX_READ_BIT
+																			   : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	}
+	
 	uint32_t findMemoryType(uint32_t typeFilter,
 							VkMemoryPropertyFlags properties) {
 		 VkPhysicalDeviceMemoryProperties memProperties;
@@ -1551,13 +2041,20 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	}
     
 	void createDescriptorPool() {
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		std::vector<VkDescriptorPoolSize> poolSizes(2);
 		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		poolSizes[0].descriptorCount = static_cast<uint32_t>(uniformBlocksInPool *
 															 swapChainImages.size());
 		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		poolSizes[1].descriptorCount = static_cast<uint32_t>(texturesInPool *
 															 swapChainImages.size());
+		if (dynamicUniformBlocksInPool > 0) {
+			VkDescriptorPoolSize dynamicSize{};
+			dynamicSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			dynamicSize.descriptorCount = static_cast<uint32_t>(dynamicUniformBlocksInPool *
+																swapChainImages.size());
+			poolSizes.push_back(dynamicSize);
+		}
 															 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -1574,61 +2071,94 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	}
 	
 	virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int i) = 0;
+	// commands recorded before the render pass, e.g. compute passes whose results are drawn
+	virtual void populateComputeCommands(VkCommandBuffer commandBuffer, int i) {}
+	// commands recorded after the render pass, e.g. passes reading the attachments just drawn
+	virtual void populatePostRenderCommands(VkCommandBuffer commandBuffer, int i) {}
 
+    // the buffers are only allocated here: each frame is recorded by drawFrame, from the state of
+    // that frame, so what is not visible is not recorded at all
     void createCommandBuffers() {
+    	QueueFamilyIndices queueFamilyIndices = 
+    			findQueueFamilies(physicalDevice);
+
     	commandBuffers.resize(swapChainFramebuffers.size());
+    	frameCommandPools.resize(swapChainFramebuffers.size());
     	
-    	VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
-		
-		VkResult result = vkAllocateCommandBuffers(device, &allocInfo,
-				commandBuffers.data());
-		if (result != VK_SUCCESS) {
-		 	PrintVkError(result);
-			throw std::runtime_error("failed to allocate command buffers!");
+    	for (size_t i = 0; i < commandBuffers.size(); i++) {
+			// the buffers of an image are only recorded again after its previous
+			// frame has completed (imagesInFlight), so its pool can be reset
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr,
+					&frameCommandPools[i]);
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to create frame command pool!");
+			}
+
+	    	VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = frameCommandPools[i];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			
+			result = vkAllocateCommandBuffers(device, &allocInfo,
+					&commandBuffers[i]);
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to allocate command buffers!");
+			}
+		}
+	}
+
+	// records the draw calls of the frame in the command buffer of a swap chain image,
+	// at every frame just before submitting it
+	void recordCommandBuffer(size_t i) {
+		// drops whatever the previous frame of this image recorded
+		vkResetCommandPool(device, frameCommandPools[i], 0);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = nullptr; // Optional
+
+		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
+					VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
 		}
 		
-		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			beginInfo.pInheritanceInfo = nullptr; // Optional
+		populateComputeCommands(commandBuffers[i], i);
+		
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass; 
+		renderPassInfo.framebuffer = swapChainFramebuffers[i];
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = swapChainExtent;
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = initialBackgroundColor;
+		clearValues[1].depthStencil = {1.0f, 0};
+
+		renderPassInfo.clearValueCount =
+						static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+		
+		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
+				VK_SUBPASS_CONTENTS_INLINE);			
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
-						VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
-			}
-			
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass; 
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = {0, 0};
-			renderPassInfo.renderArea.extent = swapChainExtent;
-	
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = initialBackgroundColor;
-			clearValues[1].depthStencil = {1.0f, 0};
-	
-			renderPassInfo.clearValueCount =
-							static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
-			
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
-					VK_SUBPASS_CONTENTS_INLINE);			
-	
+		populateCommandBuffer(commandBuffers[i], i);
 
-			populateCommandBuffer(commandBuffers[i], i);
-			
+		vkCmdEndRenderPass(commandBuffers[i]);
 
-			vkCmdEndRenderPass(commandBuffers[i]);
+		populatePostRenderCommands(commandBuffers[i], i);
 
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
-			}
+		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
 		}
 	}
     
@@ -1695,6 +2225,10 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 		
 		updateUniformBuffer(imageIndex);
+		recordCommandBuffer(imageIndex);
+		// before the frame: what was uploaded until now and is released here can be drawn by it
+		uploads.submit();
+		uploads.update();
 		
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1785,10 +2319,13 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 		}
 		
-		vkFreeCommandBuffers(device, commandPool,
-				static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		// destroying the pools frees their command buffers
+		for (size_t i = 0; i < frameCommandPools.size(); i++) {
+			vkDestroyCommandPool(device, frameCommandPools[i], nullptr);
+		}
 				
 		pipelinesAndDescriptorSetsCleanup();
+		uniformArena.cleanup();
 
 		vkDestroyRenderPass(device, renderPass, nullptr);
 
@@ -1812,6 +2349,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyFence(device, inFlightFences[i], nullptr);
     	}
     	
+    	uploads.cleanup();
     	vkDestroyCommandPool(device, commandPool, nullptr);
     	
  		vkDestroyDevice(device, nullptr);
@@ -1910,8 +2448,18 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 	Color.hasIt = false; Color.offset = 0;
 	Tangent.hasIt = false; Tangent.offset = 0;
 	
-	if(B.size() == 1) {	// for now, read models only with every vertex information in a single binding
+	// models are read with every vertex information in a single binding: the other bindings
+	// have VK_VERTEX_INPUT_RATE_INSTANCE, and are filled by an InstanceBuffer
+	int vertexBindings = 0;
+	for(int i = 0; i < B.size(); i++) {
+		if(B[i].inputRate == VK_VERTEX_INPUT_RATE_VERTEX) {
+			vertexBindings++;
+			vertexBinding = B[i].binding;
+		}
+	}
+	if(vertexBindings == 1) {
 		for(int i = 0; i < E.size(); i++) {
+			if(E[i].binding != vertexBinding) continue;
 			switch(E[i].usage) {
 			  case VertexDescriptorElementUsage::POSITION:
 			    if(E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
@@ -1978,7 +2526,7 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 			}
 		}
 	} else {
-		throw std::runtime_error("Vertex format with more than one binding is not supported yet\n");
+		throw std::runtime_error("Vertex format needs exactly one per vertex binding\n");
 	}
 }
 
@@ -2018,16 +2566,16 @@ void Model<Vert>::loadModelOBJ(std::string file) {
 	std::vector<tinyobj::material_t> materials;
 	std::string warn, err;
 	
-	std::cout << "Loading : " << file << "[OBJ]\n";	
+	TaskLog::stream() << "Loading : " << file << "[OBJ]\n";	
 	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
 						  file.c_str())) {
 		throw std::runtime_error(warn + err);
 	}
 	
-	std::cout << "Building\n";	
-//	std::cout << "Position " << VD->Position.hasIt << "," << VD->Position.offset << "\n";	
-//	std::cout << "UV " << VD->UV.hasIt << "," << VD->UV.offset << "\n";	
-//	std::cout << "Normal " << VD->Normal.hasIt << "," << VD->Normal.offset << "\n";	
+	TaskLog::stream() << "Building\n";	
+//	TaskLog::stream() << "Position " << VD->Position.hasIt << "," << VD->Position.offset << "\n";	
+//	TaskLog::stream() << "UV " << VD->UV.hasIt << "," << VD->UV.offset << "\n";	
+//	TaskLog::stream() << "Normal " << VD->Normal.hasIt << "," << VD->Normal.offset << "\n";	
 	for (const auto& shape : shapes) {
 		for (const auto& index : shape.mesh.indices) {
 			Vert vertex{};
@@ -2074,58 +2622,20 @@ void Model<Vert>::loadModelOBJ(std::string file) {
 			indices.push_back(vertices.size()-1);
 		}
 	}
-	std::cout << "[OBJ] Vertices: "<< vertices.size() << "\n";
-	std::cout << "Indices: "<< indices.size() << "\n";
+	TaskLog::stream() << "[OBJ] Vertices: "<< vertices.size() << "\n";
+	TaskLog::stream() << "Indices: "<< indices.size() << "\n";
 	
 }
 
 template <class Vert>
 void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 	tinygltf::Model model;
-	tinygltf::TinyGLTF loader;
-	std::string warn, err;
 	
-	std::cout << "Loading : " << file << (encoded ? "[MGCG]" : "[GLTF]") << "\n";	
-	if(encoded) {
-		auto modelString = readFile(file);
-		
-		const std::vector<unsigned char> key = plusaes::key_from_string(&"CG2023SkelKey128"); // 16-char = 128-bit
-		const unsigned char iv[16] = {
-			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-			0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
-		};
-
-		// decrypt
-		unsigned long padded_size = 0;
-		std::vector<unsigned char> decrypted(modelString.size());
-
-		plusaes::decrypt_cbc((unsigned char*)modelString.data(), modelString.size(), &key[0], key.size(), &iv, &decrypted[0], decrypted.size(), &padded_size);
-
-		int size = 0;
-		void *decomp;
-		
-		sscanf(reinterpret_cast<char *const>(&decrypted[0]), "%d", &size);
-//std::cout << decrypted.size() << ", decomp: " << size << "\n";
-//for(int i=0;i<32;i++) {
-//	std::cout << (int)decrypted[i] << "\n";
-//}
-
-		decomp = calloc(size, 1);
-		int n = sinflate(decomp, (int)size, &decrypted[16], decrypted.size()-16);
-		
-		if (!loader.LoadASCIIFromString(&model, &warn, &err, 
-						reinterpret_cast<const char *>(decomp), size, "/")) {
-			throw std::runtime_error(warn + err);
-		}
-	} else {
-		if (!loader.LoadASCIIFromFile(&model, &warn, &err, 
-						file.c_str())) {
-			throw std::runtime_error(warn + err);
-		}
-	}
+	TaskLog::stream() << "Loading : " << file << (encoded ? "[MGCG]" : "[GLTF]") << "\n";	
+	decodeGLTF(file, encoded, model);
 
 	for (const auto& mesh :  model.meshes) {
-		std::cout << "Primitives: " << mesh.primitives.size() << "\n";
+		TaskLog::stream() << "Primitives: " << mesh.primitives.size() << "\n";
 		for (const auto& primitive :  mesh.primitives) {
 			if (primitive.indices < 0) {
 				continue;
@@ -2157,7 +2667,7 @@ void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 				if(cntPos > cntTot) cntTot = cntPos;
 			} else {
 				if(VD->Position.hasIt) {
-					std::cout << "Warning: vertex layout has position, but file hasn't\n";
+					TaskLog::stream() << "Warning: vertex layout has position, but file hasn't\n";
 				}
 			}
 			
@@ -2171,7 +2681,7 @@ void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 				if(cntNorm > cntTot) cntTot = cntNorm;
 			} else {
 				if(VD->Normal.hasIt) {
-					std::cout << "Warning: vertex layout has normal, but file hasn't\n";
+					TaskLog::stream() << "Warning: vertex layout has normal, but file hasn't\n";
 				}
 			}
 
@@ -2185,7 +2695,7 @@ void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 				if(cntTan > cntTot) cntTot = cntTan;
 			} else {
 				if(VD->Tangent.hasIt) {
-					std::cout << "Warning: vertex layout has tangent, but file hasn't\n";
+					TaskLog::stream() << "Warning: vertex layout has tangent, but file hasn't\n";
 				}
 			}
 
@@ -2199,7 +2709,7 @@ void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 				if(cntUV > cntTot) cntTot = cntUV;
 			} else {
 				if(VD->UV.hasIt) {
-					std::cout << "Warning: vertex layout has UV, but file hasn't\n";
+					TaskLog::stream() << "Warning: vertex layout has UV, but file hasn't\n";
 				}
 			}
 			
@@ -2277,7 +2787,7 @@ void Model<Vert>::loadModelGLTF(std::string file, bool encoded) {
 		}
 	}
 
-	std::cout << (encoded ? "[MGCG]" : "[GLTF]") << " Vertices: " << vertices.size()
+	TaskLog::stream() << (encoded ? "[MGCG]" : "[GLTF]") << " Vertices: " << vertices.size()
 			  << "\nIndices: " << indices.size() << "\n";
 }
 
@@ -2285,58 +2795,97 @@ template <class Vert>
 void Model<Vert>::createVertexBuffer() {
 	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						vertexBuffer, vertexBufferMemory);
-
-	void* data;
-	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, vertexBufferMemory);			
+	uploadTicket = std::max(uploadTicket, BP->createFilledBuffer(vertices.data(), bufferSize,
+									VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, memory,
+									vertexBuffer, vertexBufferMemory));
 }
 
 template <class Vert>
 void Model<Vert>::createIndexBuffer() {
 	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-							 indexBuffer, indexBufferMemory);
+	uploadTicket = std::max(uploadTicket, BP->createFilledBuffer(indices.data(), bufferSize,
+									VK_BUFFER_USAGE_INDEX_BUFFER_BIT, memory,
+									indexBuffer, indexBufferMemory));
+}
 
-	void* data;
-	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, indexBufferMemory);
+template <class Vert>
+bool Model<Vert>::isReady() const {
+	return BP->uploads.isReady(uploadTicket);
 }
 
 template <class Vert>
-void Model<Vert>::initMesh(BaseProject *bp, VertexDescriptor *vd) {
+void Model<Vert>::loadMesh(BaseProject *bp, VertexDescriptor *vd) {
 	BP = bp;
 	VD = vd;
 	std::cout << "[Manual] Vertices: " << vertices.size()
 			  << "\nIndices: " << indices.size() << "\n";
+	computeBounds();
+}
+
+template <class Vert>
+void Model<Vert>::initMesh(BaseProject *bp, VertexDescriptor *vd) {
+	loadMesh(bp, vd);
 	createVertexBuffer();
 	createIndexBuffer();
 }
 
 template <class Vert>
-void Model<Vert>::init(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelType MT) {
+void Model<Vert>::load(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelType MT) {
 	BP = bp;
 	VD = vd;
-	if(MT == OBJ) {
-		loadModelOBJ(file);
-	} else if(MT == GLTF) {
-		loadModelGLTF(file, false);
-	} else if(MT == MGCG) {
-		loadModelGLTF(file, true);
+	// the file is decoded only if the cache next to it wasn't saved from the same bytes and vertex layout
+	std::string cacheFile = MeshCache::cacheFile(file);
+	uint64_t sourceHash = MeshCache::hashFile(file);
+	if(sourceHash != 0 && MeshCache::load(cacheFile, sourceHash, layoutHash(), vertices, indices)) {
+		TaskLog::stream() << "Loading : " << file << "[cache] Vertices: " << vertices.size()
+				  << "\nIndices: " << indices.size() << "\n";
+	} else {
+		if(MT == OBJ) {
+			loadModelOBJ(file);
+		} else if(MT == GLTF) {
+			loadModelGLTF(file, false);
+		} else if(MT == MGCG) {
+			loadModelGLTF(file, true);
+		}
+		if(sourceHash != 0) {
+			MeshCache::save(cacheFile, sourceHash, layoutHash(), vertices, indices);
+		}
 	}
 	
+	computeBounds();
+}
+
+template <class Vert>
+void Model<Vert>::init(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelType MT) {
+	load(bp, vd, file, MT);
 	createVertexBuffer();
 	createIndexBuffer();
 }
 
+// components of the vertex descriptor the decoders write: a cache is only valid for the same ones
+template <class Vert>
+uint64_t Model<Vert>::layoutHash() const {
+	uint32_t layout[] = {static_cast<uint32_t>(sizeof(Vert)),
+						 VD->Position.hasIt, VD->Position.offset, VD->Normal.hasIt, VD->Normal.offset,
+						 VD->Tangent.hasIt, VD->Tangent.offset, VD->UV.hasIt, VD->UV.offset};
+	return MeshCache::hashBytes(layout, sizeof(layout));
+}
+
+template <class Vert>
+void Model<Vert>::computeBounds() {
+	bounds = BoundingVolume();
+	if(!VD->Position.hasIt) {
+		return;
+	}
+	for(Vert &vertex : vertices) {
+		bounds.add(*(glm::vec3 *)((char*)(&vertex) + VD->Position.offset));
+	}
+	for(Vert &vertex : vertices) {
+		bounds.fit(*(glm::vec3 *)((char*)(&vertex) + VD->Position.offset));
+	}
+}
+
 template <class Vert>
 void Model<Vert>::cleanup() {
    	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
@@ -2356,6 +2905,137 @@ void Model<Vert>::bind(VkCommandBuffer commandBuffer) {
 							VK_INDEX_TYPE_UINT32);
 }
 
+template <class Vert>
+GeometryRange GeometryPool<Vert>::add(const Model<Vert> &model) {
+	GeometryRange range{};
+	range.indexCount = static_cast<uint32_t>(model.indices.size());
+	range.firstIndex = static_cast<uint32_t>(indices.size());
+	range.vertexOffset = static_cast<int32_t>(vertices.size());
+	vertices.insert(vertices.end(), model.vertices.begin(), model.vertices.end());
+	indices.insert(indices.end(), model.indices.begin(), model.indices.end());
+	return range;
+}
+
+// another index list on the vertices of a model already added, e.g. one of its levels of detail
+template <class Vert>
+GeometryRange GeometryPool<Vert>::addLevel(const GeometryRange &base, const std::vector<uint32_t> &levelIndices) {
+	GeometryRange range = base;
+	range.indexCount = static_cast<uint32_t>(levelIndices.size());
+	range.firstIndex = static_cast<uint32_t>(indices.size());
+	indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+	return range;
+}
+
+// has to be called after all the models are added
+template <class Vert>
+void GeometryPool<Vert>::create(BaseProject *bp, BufferMemory memory) {
+	BP = bp;
+	std::cout << "[Pool] Vertices: " << vertices.size()
+			  << "\nIndices: " << indices.size() << "\n";
+
+	VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
+	uploadTicket = BP->createFilledBuffer(vertices.data(), vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, memory,
+										  vertexBuffer, vertexBufferMemory);
+
+	VkDeviceSize indexBufferSize = sizeof(indices[0]) * indices.size();
+	uploadTicket = std::max(uploadTicket, BP->createFilledBuffer(indices.data(), indexBufferSize,
+										  VK_BUFFER_USAGE_INDEX_BUFFER_BIT, memory,
+										  indexBuffer, indexBufferMemory));
+
+	// the models keep their own copy
+	vertices = std::vector<Vert>();
+	indices = std::vector<uint32_t>();
+}
+
+template <class Vert>
+bool GeometryPool<Vert>::isReady() const {
+	return BP->uploads.isReady(uploadTicket);
+}
+
+template <class Vert>
+void GeometryPool<Vert>::cleanup() {
+   	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
+   	vkFreeMemory(BP->device, indexBufferMemory, nullptr);
+	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
+   	vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+}
+
+template <class Vert>
+void GeometryPool<Vert>::bind(VkCommandBuffer commandBuffer) {
+	VkBuffer vertexBuffers[] = {vertexBuffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
+							VK_INDEX_TYPE_UINT32);
+}
+
+template <class Vert>
+void GeometryPool<Vert>::draw(VkCommandBuffer commandBuffer, const GeometryRange &range,
+							  uint32_t instances, uint32_t firstInstance) {
+	vkCmdDrawIndexed(commandBuffer, range.indexCount, instances,
+					 range.firstIndex, range.vertexOffset, firstInstance);
+}
+
+template <class Inst>
+void InstanceBuffer<Inst>::init(BaseProject *bp, uint32_t maxInstances) {
+	BP = bp;
+	capacity = maxInstances;
+	size_t images = BP->swapChainImages.size();
+	buffers.resize(images);
+	buffersMemory.resize(images);
+	instances.resize(images);
+	counts.assign(images, 0);
+
+	VkDeviceSize size = sizeof(Inst) * capacity;
+	for (size_t i = 0; i < images; i++) {
+		BP->createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 buffers[i], buffersMemory[i]);
+		void *data;
+		VkResult result = vkMapMemory(BP->device, buffersMemory[i], 0, size, 0, &data);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to map instance buffer!");
+		}
+		instances[i] = static_cast<Inst *>(data);
+	}
+}
+
+template <class Inst>
+void InstanceBuffer<Inst>::clear(int currentImage) {
+	counts[currentImage] = 0;
+}
+
+template <class Inst>
+uint32_t InstanceBuffer<Inst>::add(int currentImage, const Inst &instance) {
+	if (counts[currentImage] == capacity) {
+		throw std::runtime_error("too many instances for the instance buffer!");
+	}
+	instances[currentImage][counts[currentImage]] = instance;
+	return counts[currentImage]++;
+}
+
+// after the pipeline: stays bound for all its draws
+template <class Inst>
+void InstanceBuffer<Inst>::bind(VkCommandBuffer commandBuffer, int currentImage, uint32_t binding) {
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, binding, 1, &buffers[currentImage], offsets);
+}
+
+template <class Inst>
+void InstanceBuffer<Inst>::cleanup() {
+	for (size_t i = 0; i < buffers.size(); i++) {
+		vkUnmapMemory(BP->device, buffersMemory[i]);
+		vkDestroyBuffer(BP->device, buffers[i], nullptr);
+		vkFreeMemory(BP->device, buffersMemory[i], nullptr);
+	}
+	buffers.clear();
+	buffersMemory.clear();
+	instances.clear();
+	counts.clear();
+}
+
 
 
 
@@ -2389,26 +3069,17 @@ void Texture::createTextureImage(const char *const files[], VkFormat Fmt = VK_FO
 		}
 	}
 	
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	VkDeviceSize totalImageSize = texWidth * texHeight * 4 * imgs;
 	mipLevels = static_cast<uint32_t>(std::floor(
 					std::log2(std::max(texWidth, texHeight)))) + 1;
-	
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	 
-	BP->createBuffer(totalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	  						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-	  						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	  						stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(BP->device, stagingBufferMemory, 0, totalImageSize, 0, &data);
+	uploadTextureImage(pixels, texWidth, texHeight, Fmt);
 	for(int i = 0; i < imgs; i++) {
-		memcpy(static_cast<char *>(data) + imageSize * i, pixels[i], static_cast<size_t>(imageSize));
 		stbi_image_free(pixels[i]);
 	}
-	vkUnmapMemory(BP->device, stagingBufferMemory);
-	
+}
+
+// copies the RGBA pixels of the imgs layers to a new image and generates its mipLevels, with the uploads of BP
+void Texture::uploadTextureImage(const unsigned char *const pixels[], int texWidth, int texHeight, VkFormat Fmt) {
+	VkDeviceSize imageSize = texWidth * texHeight * 4;
 	
 	BP->createImage(texWidth, texHeight, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
 				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
@@ -2416,17 +3087,20 @@ void Texture::createTextureImage(const char *const files[], VkFormat Fmt = VK_FO
 				imgs == 6 ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
 				textureImageMemory);
-				
-	BP->transitionImageLayout(textureImage, Fmt,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgs);
-	BP->copyBufferToImage(stagingBuffer, textureImage,
-			static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), imgs);
 
-	BP->generateMipmaps(textureImage, Fmt,
-					texWidth, texHeight, mipLevels, imgs);
-
-	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-	vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+	std::vector<ImageUploadRegion> regions(imgs);
+	for(int i = 0; i < imgs; i++) {
+		regions[i].data = pixels[i];
+		regions[i].size = imageSize;
+		regions[i].copy = {};
+		regions[i].copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].copy.imageSubresource.mipLevel = 0;
+		regions[i].copy.imageSubresource.baseArrayLayer = i;
+		regions[i].copy.imageSubresource.layerCount = 1;
+		regions[i].copy.imageOffset = {0, 0, 0};
+		regions[i].copy.imageExtent = {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1};
+	}
+	BP->uploads.uploadImage(textureImage, Fmt, texWidth, texHeight, mipLevels, imgs, regions, true);
 }
 
 void Texture::createTextureImageView(VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
@@ -2476,27 +3150,92 @@ void Texture::createTextureSampler(
 	
 
 
-void Texture::init(BaseProject *bp, const char *  file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB, bool initSampler = true) {
-	const char *files[1] = {file};
-	BP = bp;
-	imgs = 1;
-	createTextureImage(files, Fmt);
-	createTextureImageView(Fmt);
-	if(initSampler) {
-		createTextureSampler();
+// decodes the image, or reads the baked file next to it when there is one
+void Texture::load(BaseProject *bp, const char *file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
+	std::string baked = bakedFile(file);
+	if (canUseBaked(bp, baked, Fmt)) {
+		KTX2Texture texture = KTX2Texture::read(baked);
+		if (texture.isBakedFrom({file})) {
+			loadBaked(bp, std::move(texture), VK_SAMPLER_ADDRESS_MODE_REPEAT);
+			TaskLog::stream() << file << " -> baked: " << baked << "\n";
+			return;
+		}
+		TaskLog::stream() << "Baked " << baked << " is older than " << file << ", decoding it\n";
+	}
+	int texWidth, texHeight, texChannels;
+	stbi_uc *pixels = stbi_load(file, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		TaskLog::stream() << "Not found: " << file << "\n";
+		throw std::runtime_error("failed to load texture image!");
 	}
+	TaskLog::stream() << file << " -> size: " << texWidth << "x" << texHeight << ", ch: " << texChannels << "\n";
+	RGBAImage image(texWidth, texHeight);
+	memcpy(image.pixels.data(), pixels, image.pixels.size());
+	stbi_image_free(pixels);
+	loadPixels(bp, std::move(image), UINT32_MAX, Fmt, VK_SAMPLER_ADDRESS_MODE_REPEAT);
 }
 
-
-void Texture::initCubic(BaseProject *bp, const char * files[6]) {
+// RGBA pixels, given at most maxLevels mip levels when the texture is created
+void Texture::loadPixels(BaseProject *bp, RGBAImage pixels, uint32_t maxLevels, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB,
+						 VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT) {
 	BP = bp;
-	imgs = 6;
-	createTextureImage(files);
-	createTextureImageView();
-	createTextureSampler();
+	imgs = 1;
+	decodedImage = std::move(pixels);
+	bakedImage = KTX2Texture();
+	format = Fmt;
+	maxMipLevels = maxLevels;
+	addressMode = samplerAddressMode;
 }
 
-
+// the levels of the file are copied as they are: nothing to decode and no blits to generate them
+void Texture::loadBaked(BaseProject *bp, KTX2Texture baked,
+						VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT) {
+	format = static_cast<VkFormat>(baked.vkFormat);
+	if (format != VK_FORMAT_BC1_RGB_SRGB_BLOCK && format != VK_FORMAT_BC3_SRGB_BLOCK) {
+		throw std::runtime_error("unsupported format of baked texture!");
+	}
+	BP = bp;
+	imgs = 1;
+	bakedImage = std::move(baked);
+	decodedImage = RGBAImage();
+	maxMipLevels = static_cast<uint32_t>(bakedImage.levels.size());
+	addressMode = samplerAddressMode;
+}
+
+void Texture::create(bool initSampler = true) {
+	if (!bakedImage.levels.empty()) {
+		mipLevels = static_cast<uint32_t>(bakedImage.levels.size());
+		uploadCompressedImage(bakedImage);
+	} else {
+		const unsigned char *layers[1] = {decodedImage.pixels.data()};
+		mipLevels = std::min(maxMipLevels, static_cast<uint32_t>(std::floor(
+						std::log2(std::max(decodedImage.width, decodedImage.height)))) + 1);
+		uploadTextureImage(layers, decodedImage.width, decodedImage.height, format);
+	}
+	createTextureImageView(format);
+	if (initSampler) {
+		createTextureSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, addressMode, addressMode);
+	}
+	// the pixels are in the image now
+	decodedImage = RGBAImage();
+	bakedImage = KTX2Texture();
+}
+
+void Texture::init(BaseProject *bp, const char *  file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB, bool initSampler = true) {
+	load(bp, file, Fmt);
+	create(initSampler);
+}
+
+
+void Texture::initCubic(BaseProject *bp, const char * files[6]) {
+	BP = bp;
+	imgs = 6;
+	createTextureImage(files);
+	createTextureImageView();
+	createTextureSampler();
+}
+
+
 void Texture::cleanup() {
    	vkDestroySampler(BP->device, textureSampler, nullptr);
    	vkDestroyImageView(BP->device, textureImageView, nullptr);
@@ -2505,6 +3244,108 @@ void Texture::cleanup() {
 }
 
 
+std::string Texture::bakedFile(const std::string &file) {
+	size_t extension = file.find_last_of('.');
+	return (extension == std::string::npos ? file : file.substr(0, extension)) + ".ktx2";
+}
+
+// baked files are sRGB: linear textures are still decoded from their images
+bool Texture::canUseBaked(BaseProject *bp, const std::string &baked, VkFormat Fmt) {
+	return bp->textureCompressionBCSupport && Fmt == VK_FORMAT_R8G8B8A8_SRGB && KTX2Texture::exists(baked);
+}
+
+void Texture::uploadCompressedImage(const KTX2Texture &baked) {
+	VkFormat Fmt = static_cast<VkFormat>(baked.vkFormat);
+	std::vector<ImageUploadRegion> regions(baked.levels.size());
+	for (uint32_t level = 0; level < baked.levels.size(); level++) {
+		regions[level].data = baked.levels[level].data();
+		regions[level].size = baked.levels[level].size();
+		regions[level].copy = {};
+		regions[level].copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[level].copy.imageSubresource.mipLevel = level;
+		regions[level].copy.imageSubresource.baseArrayLayer = 0;
+		regions[level].copy.imageSubresource.layerCount = 1;
+		regions[level].copy.imageOffset = {0, 0, 0};
+		regions[level].copy.imageExtent = {std::max(baked.width >> level, 1u), std::max(baked.height >> level, 1u), 1};
+	}
+
+	BP->createImage(baked.width, baked.height, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+	BP->uploads.uploadImage(textureImage, Fmt, baked.width, baked.height, mipLevels, imgs, regions, false);
+}
+
+
+// The baked atlas is used if it has a region for each of the images, found by file name in its atlasRegions key
+// (see texture-baker), otherwise the images are decoded and packed here.
+void TextureAtlas::load(BaseProject *bp, const std::vector<std::string> &files, const std::string &baked = "",
+						VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
+	if (!baked.empty() && Texture::canUseBaked(bp, baked, Fmt)) {
+		KTX2Texture atlas = KTX2Texture::read(baked);
+		std::istringstream lines(atlas.value("atlasRegions"));
+		std::map<std::string, glm::vec4> bakedRegions;
+		std::string name;
+		glm::vec4 region;
+		while (lines >> name >> region.x >> region.y >> region.z >> region.w) {
+			bakedRegions[name] = region;
+		}
+		regions.clear();
+		for (const auto &file : files) {
+			auto found = bakedRegions.find(file.substr(file.find_last_of("/\\") + 1));
+			if (found == bakedRegions.end()) break;
+			regions.push_back(found->second);
+		}
+		if (regions.size() != files.size()) {
+			TaskLog::stream() << "Baked atlas " << baked << " doesn't have all the images, packing them again\n";
+		} else if (!atlas.isBakedFrom(files)) {
+			TaskLog::stream() << "Baked atlas " << baked << " is older than its images, packing them again\n";
+		} else {
+			texture.loadBaked(bp, std::move(atlas), VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+			TaskLog::stream() << "Texture atlas of " << files.size() << " images -> baked: " << baked << "\n";
+			return;
+		}
+	}
+
+	std::vector<RGBAImage> images(files.size());
+	for (size_t i = 0; i < files.size(); i++) {
+		int channels;
+		stbi_uc *pixels = stbi_load(files[i].c_str(), &images[i].width, &images[i].height,
+									&channels, STBI_rgb_alpha);
+		if (!pixels) {
+			TaskLog::stream() << "Not found: " << files[i] << "\n";
+			throw std::runtime_error("failed to load texture image!");
+		}
+		images[i].pixels.assign(pixels, pixels + static_cast<size_t>(images[i].width) * images[i].height * 4);
+		stbi_image_free(pixels);
+	}
+	RGBAImage atlas = AtlasPacking::pack(images, regions);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(bp->physicalDevice, &properties);
+	if (atlas.width > static_cast<int>(properties.limits.maxImageDimension2D) ||
+		atlas.height > static_cast<int>(properties.limits.maxImageDimension2D)) {
+		throw std::runtime_error("texture atlas too large for the device!");
+	}
+	TaskLog::stream() << "Texture atlas of " << files.size() << " images -> size: " << atlas.width << "x" << atlas.height << "\n";
+	texture.loadPixels(bp, std::move(atlas), AtlasPacking::MIP_LEVELS, Fmt, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+}
+
+void TextureAtlas::create() {
+	texture.create(true);
+}
+
+void TextureAtlas::init(BaseProject *bp, const std::vector<std::string> &files, const std::string &baked = "",
+						VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
+	load(bp, files, baked, Fmt);
+	create();
+}
+
+void TextureAtlas::cleanup() {
+	texture.cleanup();
+	regions.clear();
+}
+
+
 
 
 
@@ -2530,6 +3371,7 @@ void Pipeline::init(BaseProject *bp, VertexDescriptor *vd,
  	polyModel = VK_POLYGON_MODE_FILL;
  	CM = VK_CULL_MODE_BACK_BIT;
  	transp = false;
+ 	depthWrite = true;
 
 	D = d;
 }
@@ -2542,6 +3384,11 @@ void Pipeline::setAdvancedFeatures(VkCompareOp _compareOp, VkPolygonMode _polyMo
  	transp = _transp;
 }
 
+// still depth tested: e.g. overlays, drawn last, that must not hide the scene from the depth pyramid
+void Pipeline::setDepthWrite(bool _depthWrite) {
+ 	depthWrite = _depthWrite;
+}
+
 
 void Pipeline::create() {	
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -2666,8 +3513,9 @@ void Pipeline::create() {
 		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = DSL.size();
 	pipelineLayoutInfo.pSetLayouts = DSL.data();
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	pipelineLayoutInfo.pushConstantRangeCount =
+				static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
 	
 	VkResult result = vkCreatePipelineLayout(BP->device, &pipelineLayoutInfo, nullptr,
 				&pipelineLayout);
@@ -2680,7 +3528,7 @@ void Pipeline::create() {
 	depthStencil.sType = 
 			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = depthWrite ? VK_TRUE : VK_FALSE;
 	depthStencil.depthCompareOp = compareOp;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f; // Optional
@@ -2747,6 +3595,21 @@ VkShaderModule Pipeline::createShaderModule(const std::vector<char>& code) {
 	return shaderModule;
 }
 
+// has to be called before create(): the ranges are part of the pipeline layout
+// (at least 128 bytes are available on every device)
+void Pipeline::addPushConstantRange(VkShaderStageFlags stages, uint32_t offset, uint32_t size) {
+	VkPushConstantRange range{};
+	range.stageFlags = stages;
+	range.offset = offset;
+	range.size = size;
+	pushConstantRanges.push_back(range);
+}
+
+void Pipeline::push(VkCommandBuffer commandBuffer, VkShaderStageFlags stages, uint32_t offset,
+					uint32_t size, const void *values) {
+	vkCmdPushConstants(commandBuffer, pipelineLayout, stages, offset, size, values);
+}
+
 void Pipeline::cleanup() {
 		vkDestroyPipeline(BP->device, graphicsPipeline, nullptr);
 		vkDestroyPipelineLayout(BP->device, pipelineLayout, nullptr);
@@ -2786,24 +3649,20 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 						 std::vector<DescriptorSetElement> E) {
 	BP = bp;
 	
-	uniformBuffers.resize(E.size());
-	uniformBuffersMemory.resize(E.size());
-	toFree.resize(E.size());
-
+	uniforms.resize(E.size());
+	dynamicStrides.assign(E.size(), 0);
+	if (std::count_if(E.begin(), E.end(), [](const DescriptorSetElement &e) {
+			return e.type == UNIFORM_DYNAMIC; }) > maxDynamicUniforms) {
+		throw std::runtime_error("too many dynamic uniforms in a descriptor set!");
+	}
 	for (int j = 0; j < E.size(); j++) {
-		uniformBuffers[j].resize(BP->swapChainImages.size());
-		uniformBuffersMemory[j].resize(BP->swapChainImages.size());
 		if(E[j].type == UNIFORM) {
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				VkDeviceSize bufferSize = E[j].size;
-				BP->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-									 	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-									 	 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i]);
-			}
-			toFree[j] = true;
-		} else {
-			toFree[j] = false;
+			uniforms[j] = BP->uniformArena.allocate(E[j].size);
+		} else if(E[j].type == UNIFORM_DYNAMIC) {
+			// dynamic offsets have to be aligned as any other uniform offset
+			VkDeviceSize alignment = BP->uniformArena.alignment;
+			dynamicStrides[j] = (E[j].size + alignment - 1) / alignment * alignment;
+			uniforms[j] = BP->uniformArena.allocate(dynamicStrides[j] * E[j].count);
 		}
 	}
 	
@@ -2829,16 +3688,18 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 		std::vector<VkDescriptorBufferInfo> bufferInfo(E.size());
 		std::vector<VkDescriptorImageInfo> imageInfo(E.size());
 		for (int j = 0; j < E.size(); j++) {
-			if(E[j].type == UNIFORM) {
-				bufferInfo[j].buffer = uniformBuffers[j][i];
-				bufferInfo[j].offset = 0;
+			if(E[j].type == UNIFORM || E[j].type == UNIFORM_DYNAMIC) {
+				bufferInfo[j].buffer = BP->uniformArena.buffer(uniforms[j], i);
+				bufferInfo[j].offset = uniforms[j].offset;
 				bufferInfo[j].range = E[j].size;
 				
 				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 				descriptorWrites[j].dstSet = descriptorSets[i];
 				descriptorWrites[j].dstBinding = E[j].binding;
 				descriptorWrites[j].dstArrayElement = 0;
-				descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+				descriptorWrites[j].descriptorType = E[j].type == UNIFORM ?
+											VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER :
+											VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 				descriptorWrites[j].descriptorCount = 1;
 				descriptorWrites[j].pBufferInfo = &bufferInfo[j];
 			} else if(E[j].type == TEXTURE) {
@@ -2863,14 +3724,9 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 }
 
 void DescriptorSet::cleanup() {
-	for(int j = 0; j < uniformBuffers.size(); j++) {
-		if(toFree[j]) {
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				vkDestroyBuffer(BP->device, uniformBuffers[j][i], nullptr);
-				vkFreeMemory(BP->device, uniformBuffersMemory[j][i], nullptr);
-			}
-		}
-	}
+	// the uniform blocks are released with the whole arena, and the sets with the descriptor pool
+	uniforms.clear();
+	dynamicStrides.clear();
 }
 
 void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
@@ -2881,11 +3737,989 @@ void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
 					0, nullptr);
 }
 
+// binds the set using block index of every UNIFORM_DYNAMIC element
+// (elements have to be listed in binding order, as Vulkan reads the offsets in that order)
+void DescriptorSet::bindDynamic(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
+						 int currentImage, int index) {
+	std::array<uint32_t, maxDynamicUniforms> offsets;
+	uint32_t offsetCount = 0;
+	for (VkDeviceSize stride : dynamicStrides) {
+		if (stride > 0) {
+			offsets[offsetCount++] = static_cast<uint32_t>(stride * index);
+		}
+	}
+	vkCmdBindDescriptorSets(commandBuffer,
+					VK_PIPELINE_BIND_POINT_GRAPHICS,
+					P.pipelineLayout, setId, 1, &descriptorSets[currentImage],
+					offsetCount, offsets.data());
+}
+
 void DescriptorSet::map(int currentImage, void *src, int size, int slot) {
-	void* data;
+	// the arena is always mapped and coherent: nothing else to do
+	memcpy(BP->uniformArena.pointer(uniforms[slot], currentImage), src, size);
+}
 
-	vkMapMemory(BP->device, uniformBuffersMemory[slot][currentImage], 0,
-						size, 0, &data);
-	memcpy(data, src, size);
-	vkUnmapMemory(BP->device, uniformBuffersMemory[slot][currentImage]);	
+void DescriptorSet::mapDynamic(int currentImage, void *src, int size, int slot, int index) {
+	char *block = static_cast<char *>(BP->uniformArena.pointer(uniforms[slot], currentImage));
+	memcpy(block + dynamicStrides[slot] * index, src, size);
+}
+
+void UniformArena::init(BaseProject *bp) {
+	BP = bp;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(BP->physicalDevice, &properties);
+	alignment = properties.limits.minUniformBufferOffsetAlignment;
+}
+
+void UniformArena::addBlock(VkDeviceSize size) {
+	size_t images = BP->swapChainImages.size();
+	buffers.emplace_back(images);
+	buffersMemory.emplace_back(images);
+	mapped.emplace_back(images);
+	for (size_t i = 0; i < images; i++) {
+		BP->createBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 buffers.back()[i], buffersMemory.back()[i]);
+		void *data;
+		VkResult result = vkMapMemory(BP->device, buffersMemory.back()[i], 0, size, 0, &data);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to map uniform arena!");
+		}
+		mapped.back()[i] = static_cast<char *>(data);
+	}
+	used = 0;
+}
+
+UniformAllocation UniformArena::allocate(VkDeviceSize size) {
+	VkDeviceSize offset = (used + alignment - 1) / alignment * alignment;
+	if (buffers.empty() || offset + size > blockSize) {
+		// blocks bigger than usual only for uniforms that don't fit a normal one
+		addBlock(std::max(blockSize, size));
+		offset = 0;
+	}
+	used = offset + size;
+	return {static_cast<uint32_t>(buffers.size() - 1), offset};
+}
+
+VkBuffer UniformArena::buffer(UniformAllocation allocation, int currentImage) {
+	return buffers[allocation.block][currentImage];
+}
+
+void *UniformArena::pointer(UniformAllocation allocation, int currentImage) {
+	return mapped[allocation.block][currentImage] + allocation.offset;
+}
+
+void UniformArena::cleanup() {
+	for (size_t b = 0; b < buffers.size(); b++) {
+		for (size_t i = 0; i < buffers[b].size(); i++) {
+			vkUnmapMemory(BP->device, buffersMemory[b][i]);
+			vkDestroyBuffer(BP->device, buffers[b][i], nullptr);
+			vkFreeMemory(BP->device, buffersMemory[b][i], nullptr);
+		}
+	}
+	buffers.clear();
+	buffersMemory.clear();
+	mapped.clear();
+	used = 0;
+}
+
+void UploadManager::init(BaseProject *bp, uint32_t graphicsQueueFamily, uint32_t transferQueueFamily) {
+	BP = bp;
+	graphicsFamily = graphicsQueueFamily;
+	transferFamily = transferQueueFamily;
+	vkGetDeviceQueue(BP->device, transferFamily, 0, &transferQueue);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = graphicsFamily;
+	VkResult result = vkCreateCommandPool(BP->device, &poolInfo, nullptr, &graphicsPool);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+	transferPool = graphicsPool;
+	if (dedicatedTransfer()) {
+		poolInfo.queueFamilyIndex = transferFamily;
+		result = vkCreateCommandPool(BP->device, &poolInfo, nullptr, &transferPool);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+	}
+	std::cout << "Uploads on " << (dedicatedTransfer() ? "the transfer" : "the graphics") << " queue family "
+			  << transferFamily << "\n";
+}
+
+// starts a batch, if none is being recorded
+void UploadManager::begin() {
+	if (isRecording) {
+		return;
+	}
+	recording = Batch();
+	recording.ticket = nextTicket++;
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	allocInfo.commandPool = transferPool;
+	vkAllocateCommandBuffers(BP->device, &allocInfo, &recording.transferCommands);
+	vkBeginCommandBuffer(recording.transferCommands, &beginInfo);
+	recording.graphicsCommands = recording.transferCommands;
+	if (dedicatedTransfer()) {
+		allocInfo.commandPool = graphicsPool;
+		vkAllocateCommandBuffers(BP->device, &allocInfo, &recording.graphicsCommands);
+		vkBeginCommandBuffer(recording.graphicsCommands, &beginInfo);
+	}
+	isRecording = true;
+}
+
+// copies data to the staging memory of the batch: returns the staging buffer and the offset in it
+VkBuffer UploadManager::stage(const void *data, VkDeviceSize size, VkDeviceSize &offset) {
+	// 16 keeps any texel block, and the 4 bytes copies require, aligned
+	offset = recording.staging.empty() ? 0 : (recording.staging.back().used + 15) / 16 * 16;
+	if (recording.staging.empty() || offset + size > recording.staging.back().size) {
+		auto reusable = std::find_if(freeStaging.begin(), freeStaging.end(),
+									 [size](const StagingBlock &block) { return block.size >= size; });
+		if (reusable != freeStaging.end()) {
+			recording.staging.push_back(*reusable);
+			freeStaging.erase(reusable);
+		} else {
+			// blocks bigger than usual only for the uploads that don't fit a normal one
+			recording.staging.push_back(createStagingBlock(std::max(stagingBlockSize, size)));
+		}
+		recording.staging.back().used = 0;
+		offset = 0;
+	}
+	StagingBlock &block = recording.staging.back();
+	memcpy(block.mapped + offset, data, static_cast<size_t>(size));
+	block.used = offset + size;
+	return block.buffer;
+}
+
+UploadManager::StagingBlock UploadManager::createStagingBlock(VkDeviceSize size) {
+	StagingBlock block{};
+	block.size = size;
+	BP->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 block.buffer, block.memory);
+	void *data;
+	VkResult result = vkMapMemory(BP->device, block.memory, 0, size, 0, &data);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to map staging buffer!");
+	}
+	block.mapped = static_cast<char *>(data);
+	return block;
+}
+
+void UploadManager::destroyStagingBlock(StagingBlock &block) {
+	vkUnmapMemory(BP->device, block.memory);
+	vkDestroyBuffer(BP->device, block.buffer, nullptr);
+	vkFreeMemory(BP->device, block.memory, nullptr);
+}
+
+uint64_t UploadManager::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+									 VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	begin();
+	VkBufferCopy copy{};
+	copy.dstOffset = offset;
+	copy.size = size;
+	VkBuffer staging = stage(data, size, copy.srcOffset);
+	vkCmdCopyBuffer(recording.transferCommands, staging, buffer, 1, &copy);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	if (dedicatedTransfer()) {
+		// the transfer queue releases the range, the graphics queue acquires it: same barrier on both
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(recording.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		barrier.srcAccessMask = 0;
+	}
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(recording.graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+						 0, nullptr, 1, &barrier, 0, nullptr);
+	return recording.ticket;
+}
+
+uint64_t UploadManager::uploadImage(VkImage image, VkFormat format, uint32_t width, uint32_t height,
+									uint32_t mipLevels, uint32_t layers,
+									const std::vector<ImageUploadRegion> &regions, bool generateMipmaps) {
+	if (generateMipmaps && mipLevels > 1) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(BP->physicalDevice, format, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+			throw std::runtime_error("texture image format does not support linear blitting!");
+		}
+	}
+	begin();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = layers;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(recording.transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+						 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	for (const auto &region : regions) {
+		VkBufferImageCopy copy = region.copy;
+		VkBuffer staging = stage(region.data, region.size, copy.bufferOffset);
+		vkCmdCopyBufferToImage(recording.transferCommands, staging, image,
+							   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+	}
+
+	if (dedicatedTransfer()) {
+		// ownership goes to the graphics queue, the image stays in TRANSFER_DST for the blits there
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(recording.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(recording.graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	if (generateMipmaps) {
+		BP->recordMipmaps(recording.graphicsCommands, image, static_cast<int32_t>(width),
+						  static_cast<int32_t>(height), mipLevels, static_cast<int>(layers));
+	} else {
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(recording.graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	return recording.ticket;
+}
+
+uint64_t UploadManager::submit() {
+	if (!isRecording) {
+		return 0;
+	}
+	isRecording = false;
+	Batch batch = std::move(recording);
+	vkEndCommandBuffer(batch.transferCommands);
+	if (dedicatedTransfer()) {
+		vkEndCommandBuffer(batch.graphicsCommands);
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkCreateFence(BP->device, &fenceInfo, nullptr, &batch.completed);
+	if (dedicatedTransfer()) {
+		vkCreateFence(BP->device, &fenceInfo, nullptr, &batch.transferred);
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.transferCommands;
+		VkResult result = vkQueueSubmit(transferQueue, 1, &submitInfo, batch.transferred);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to submit uploads!");
+		}
+	}
+	submitted.push_back(std::move(batch));
+	if (!dedicatedTransfer()) {
+		release(submitted.back());
+	}
+	return submitted.back().ticket;
+}
+
+// submits the graphics side of a batch whose copies are complete: later frames can draw what it uploaded
+void UploadManager::release(Batch &batch) {
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.graphicsCommands;
+	VkResult result = vkQueueSubmit(BP->graphicsQueue, 1, &submitInfo, batch.completed);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to submit uploads!");
+	}
+	batch.released = true;
+	readyTicket = batch.ticket;
+}
+
+void UploadManager::update() {
+	// in order: a ticket is ready once all the ones before it are
+	for (auto &batch : submitted) {
+		if (batch.released) {
+			continue;
+		}
+		if (vkGetFenceStatus(BP->device, batch.transferred) != VK_SUCCESS) {
+			break;
+		}
+		release(batch);
+	}
+	while (!submitted.empty() && submitted.front().released &&
+		   vkGetFenceStatus(BP->device, submitted.front().completed) == VK_SUCCESS) {
+		recycle(submitted.front());
+		submitted.pop_front();
+	}
+}
+
+void UploadManager::waitReady(uint64_t ticket) {
+	if (isRecording && ticket >= recording.ticket) {
+		submit();
+	}
+	for (auto &batch : submitted) {
+		if (batch.ticket > ticket) {
+			break;
+		}
+		if (!batch.released) {
+			vkWaitForFences(BP->device, 1, &batch.transferred, VK_TRUE, UINT64_MAX);
+			release(batch);
+		}
+	}
+	update();
+}
+
+// the staging memory of a completed batch is kept for the next ones, unless it was an oversized block
+void UploadManager::recycle(Batch &batch) {
+	completedTicket = batch.ticket;
+	for (auto &block : batch.staging) {
+		if (block.size == stagingBlockSize) {
+			freeStaging.push_back(block);
+		} else {
+			destroyStagingBlock(block);
+		}
+	}
+	vkFreeCommandBuffers(BP->device, transferPool, 1, &batch.transferCommands);
+	if (dedicatedTransfer()) {
+		vkFreeCommandBuffers(BP->device, graphicsPool, 1, &batch.graphicsCommands);
+		vkDestroyFence(BP->device, batch.transferred, nullptr);
+	}
+	vkDestroyFence(BP->device, batch.completed, nullptr);
+}
+
+void UploadManager::cleanup() {
+	waitReady(nextTicket - 1);
+	for (auto &batch : submitted) {
+		vkWaitForFences(BP->device, 1, &batch.completed, VK_TRUE, UINT64_MAX);
+		recycle(batch);
+	}
+	submitted.clear();
+	for (auto &block : freeStaging) {
+		destroyStagingBlock(block);
+	}
+	freeStaging.clear();
+	if (dedicatedTransfer()) {
+		vkDestroyCommandPool(BP->device, transferPool, nullptr);
+	}
+	vkDestroyCommandPool(BP->device, graphicsPool, nullptr);
+}
+
+// the buffers are per swap chain image: init with the descriptor sets, cleanup with them
+void IndirectDrawBuffer::init(BaseProject *bp, uint32_t maxDraws) {
+	BP = bp;
+	capacity = maxDraws;
+	size_t images = BP->swapChainImages.size();
+	buffers.resize(images);
+	buffersMemory.resize(images);
+	commands.resize(images);
+	counts.assign(images, 0);
+
+	VkDeviceSize size = sizeof(VkDrawIndexedIndirectCommand) * capacity;
+	for (size_t i = 0; i < images; i++) {
+		BP->createBuffer(size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 buffers[i], buffersMemory[i]);
+		void *data;
+		VkResult result = vkMapMemory(BP->device, buffersMemory[i], 0, size, 0, &data);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to map indirect draw buffer!");
+		}
+		commands[i] = static_cast<VkDrawIndexedIndirectCommand *>(data);
+	}
+}
+
+void IndirectDrawBuffer::clear(int currentImage) {
+	counts[currentImage] = 0;
+}
+
+void IndirectDrawBuffer::add(int currentImage, const GeometryRange &range,
+							 uint32_t instances, uint32_t firstInstance) {
+	if (counts[currentImage] == capacity) {
+		throw std::runtime_error("too many draws for the indirect draw buffer!");
+	}
+	VkDrawIndexedIndirectCommand &command = commands[currentImage][counts[currentImage]++];
+	command.indexCount = range.indexCount;
+	command.instanceCount = instances;
+	command.firstIndex = range.firstIndex;
+	command.vertexOffset = range.vertexOffset;
+	command.firstInstance = firstInstance;
+}
+
+void IndirectDrawBuffer::draw(VkCommandBuffer commandBuffer, int currentImage) {
+	uint32_t count = counts[currentImage];
+	if (count == 0) {
+		return;
+	}
+	if (BP->indirectDrawSupport) {
+		vkCmdDrawIndexedIndirect(commandBuffer, buffers[currentImage], 0, count,
+								 sizeof(VkDrawIndexedIndirectCommand));
+	} else {
+		for (uint32_t d = 0; d < count; d++) {
+			const VkDrawIndexedIndirectCommand &command = commands[currentImage][d];
+			vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount,
+							 command.firstIndex, command.vertexOffset, command.firstInstance);
+		}
+	}
+}
+
+void IndirectDrawBuffer::cleanup() {
+	for (size_t i = 0; i < buffers.size(); i++) {
+		vkUnmapMemory(BP->device, buffersMemory[i]);
+		vkDestroyBuffer(BP->device, buffers[i], nullptr);
+		vkFreeMemory(BP->device, buffersMemory[i], nullptr);
+	}
+	buffers.clear();
+	buffersMemory.clear();
+	commands.clear();
+	counts.clear();
+}
+
+// size of the last frame: init it in pipelinesAndDescriptorSetsInit, cleanup with the descriptor sets
+void DepthPyramid::init(BaseProject *bp, const std::string &depthShader, const std::string &reduceShader) {
+	BP = bp;
+	supported = BP->depthSamplingSupport;
+	valid = false;
+	viewProjection = glm::mat4(1);
+
+	// power of two below the depth: every level halves the one above exactly
+	width = 1;
+	while (width * 2 <= BP->swapChainExtent.width) width *= 2;
+	height = 1;
+	while (height * 2 <= BP->swapChainExtent.height) height *= 2;
+	levels = 1;
+	while ((std::max(width, height) >> levels) > 0) levels++;
+
+	BP->createImage(width, height, levels, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT,
+					VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+	view = BP->createImageView(image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, levels,
+							   VK_IMAGE_VIEW_TYPE_2D, 1);
+	levelViews.resize(levels);
+	for (uint32_t level = 0; level < levels; level++) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+		VkResult result = vkCreateImageView(BP->device, &viewInfo, nullptr, &levelViews[level]);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create depth pyramid view!");
+		}
+	}
+	// the culling binds the levels even before the first frame is reduced
+	BP->transitionImageLayout(image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED,
+							  VK_IMAGE_LAYOUT_GENERAL, levels, 1);
+
+	// levels are read with texelFetch: the sampler never filters
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(levels);
+	samplerInfo.mipLodBias = 0.0f;
+	VkResult result = vkCreateSampler(BP->device, &samplerInfo, nullptr, &sampler);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+
+	if (!supported) return;
+
+	// one set per level: its source (the depth or the level above) and the level itself
+	DSL.init(BP, {
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
+	});
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = levels;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = levels;
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = levels;
+	result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(levels, DSL.descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = levels;
+	allocInfo.pSetLayouts = layouts.data();
+	descriptorSets.resize(levels);
+	result = vkAllocateDescriptorSets(BP->device, &allocInfo, descriptorSets.data());
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to allocate depth pyramid descriptor sets!");
+	}
+	for (uint32_t level = 0; level < levels; level++) {
+		VkDescriptorImageInfo sourceInfo{};
+		sourceInfo.sampler = sampler;
+		sourceInfo.imageView = level == 0 ? BP->depthImageView : levelViews[level - 1];
+		sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		VkDescriptorImageInfo destinationInfo{};
+		destinationInfo.imageView = levelViews[level];
+		destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[0].dstSet = descriptorSets[level];
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[0].descriptorCount = 1;
+		descriptorWrites[0].pImageInfo = &sourceInfo;
+		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[1].dstSet = descriptorSets[level];
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[1].descriptorCount = 1;
+		descriptorWrites[1].pImageInfo = &destinationInfo;
+		vkUpdateDescriptorSets(BP->device, static_cast<uint32_t>(descriptorWrites.size()),
+							   descriptorWrites.data(), 0, nullptr);
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(glm::ivec4);
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DSL.descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	result = vkCreatePipelineLayout(BP->device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+	}
+	// a multisampled depth needs its own shader to read the samples of each pixel
+	reducePipeline = BP->createComputePipeline(reduceShader, pipelineLayout);
+	depthPipeline = BP->msaaSamples == VK_SAMPLE_COUNT_1_BIT ? reducePipeline :
+					BP->createComputePipeline(depthShader, pipelineLayout);
+}
+
+// after the render pass: reduces the depth just drawn, for the culling of the next frames
+void DepthPyramid::build(VkCommandBuffer commandBuffer, const glm::mat4 &frameViewProjection) {
+	if (!supported) return;
+
+	VkImageMemoryBarrier depthBarrier{};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = BP->depthImage;
+	depthBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (BP->hasStencilComponent(BP->findDepthFormat())) {
+		depthBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	depthBarrier.subresourceRange.baseMipLevel = 0;
+	depthBarrier.subresourceRange.levelCount = 1;
+	depthBarrier.subresourceRange.baseArrayLayer = 0;
+	depthBarrier.subresourceRange.layerCount = 1;
+
+	// the culling of this frame has read the levels that are about to be overwritten
+	VkImageMemoryBarrier pyramidBarrier{};
+	pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	pyramidBarrier.srcAccessMask = 0;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = image;
+	pyramidBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	pyramidBarrier.subresourceRange.baseMipLevel = 0;
+	pyramidBarrier.subresourceRange.levelCount = levels;
+	pyramidBarrier.subresourceRange.baseArrayLayer = 0;
+	pyramidBarrier.subresourceRange.layerCount = 1;
+
+	std::array<VkImageMemoryBarrier, 2> startBarriers = {depthBarrier, pyramidBarrier};
+	vkCmdPipelineBarrier(commandBuffer,
+						 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+						 static_cast<uint32_t>(startBarriers.size()), startBarriers.data());
+
+	glm::ivec2 sourceSize(BP->swapChainExtent.width, BP->swapChainExtent.height);
+	for (uint32_t level = 0; level < levels; level++) {
+		glm::ivec2 levelSize(std::max(width >> level, 1u), std::max(height >> level, 1u));
+		glm::ivec4 sizes(sourceSize, levelSize);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+						  level == 0 ? depthPipeline : reducePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+								&descriptorSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+						   sizeof(sizes), &sizes);
+		vkCmdDispatch(commandBuffer, (levelSize.x + groupSize - 1) / groupSize,
+					  (levelSize.y + groupSize - 1) / groupSize, 1);
+
+		// the level is the source of the next one, and of the culling of the next frame
+		pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		pyramidBarrier.subresourceRange.baseMipLevel = level;
+		pyramidBarrier.subresourceRange.levelCount = 1;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+							 1, &pyramidBarrier);
+		sourceSize = levelSize;
+	}
+
+	// back to an attachment before the render pass of the next frame clears it
+	depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+								 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+						 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+	viewProjection = frameViewProjection;
+	valid = true;
+}
+
+void DepthPyramid::cleanup() {
+	if (supported) {
+		if (depthPipeline != reducePipeline) {
+			vkDestroyPipeline(BP->device, depthPipeline, nullptr);
+		}
+		vkDestroyPipeline(BP->device, reducePipeline, nullptr);
+		vkDestroyPipelineLayout(BP->device, pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+		DSL.cleanup();
+	}
+	vkDestroySampler(BP->device, sampler, nullptr);
+	for (VkImageView levelView : levelViews) {
+		vkDestroyImageView(BP->device, levelView, nullptr);
+	}
+	levelViews.clear();
+	vkDestroyImageView(BP->device, view, nullptr);
+	vkDestroyImage(BP->device, image, nullptr);
+	vkFreeMemory(BP->device, imageMemory, nullptr);
+}
+
+// per swap chain image, as the descriptor sets: init in pipelinesAndDescriptorSetsInit, cleanup with them
+void GpuCulling::init(BaseProject *bp, const std::string &shader, DepthPyramid &depthPyramid,
+					  uint32_t maxObjects, std::vector<uint32_t> maxDrawsPerList) {
+	BP = bp;
+	pyramid = &depthPyramid;
+	statistics = {};
+	objectCapacity = maxObjects;
+	listCapacities = maxDrawsPerList;
+	listStarts.resize(listCapacities.size());
+	uint32_t commandCapacity = 0;
+	for (size_t l = 0; l < listCapacities.size(); l++) {
+		listStarts[l] = commandCapacity;
+		commandCapacity += listCapacities[l];
+	}
+	size_t images = BP->swapChainImages.size();
+
+	// buffers: the ones written or read by the CPU stay mapped
+	auto createMapped = [this](VkDeviceSize size, VkBufferUsageFlags usage,
+							   VkBuffer &buffer, VkDeviceMemory &memory) {
+		BP->createBuffer(size, usage,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 buffer, memory);
+		void *data;
+		VkResult result = vkMapMemory(BP->device, memory, 0, size, 0, &data);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to map culling buffer!");
+		}
+		memset(data, 0, size);
+		return data;
+	};
+	objectBuffers.resize(images); objectBuffersMemory.resize(images); objects.resize(images);
+	commandBuffers.resize(images); commandBuffersMemory.resize(images);
+	countBuffers.resize(images); countBuffersMemory.resize(images);
+	frameBuffers.resize(images); frameBuffersMemory.resize(images); frames.resize(images);
+	statisticsBuffers.resize(images); statisticsBuffersMemory.resize(images); counters.resize(images);
+	for (size_t i = 0; i < images; i++) {
+		// no instances: unused slots are skipped
+		objects[i] = static_cast<CullObject *>(createMapped(sizeof(CullObject) * objectCapacity,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, objectBuffers[i], objectBuffersMemory[i]));
+		frames[i] = static_cast<CullFrame *>(createMapped(sizeof(CullFrame),
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, frameBuffers[i], frameBuffersMemory[i]));
+		counters[i] = static_cast<CullStatistics *>(createMapped(sizeof(CullStatistics),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				statisticsBuffers[i], statisticsBuffersMemory[i]));
+
+		BP->createBuffer(sizeof(VkDrawIndexedIndirectCommand) * commandCapacity,
+						 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						 commandBuffers[i], commandBuffersMemory[i]);
+		BP->createBuffer(sizeof(uint32_t) * listCapacities.size(),
+						 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+						 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						 countBuffers[i], countBuffersMemory[i]);
+	}
+
+	// descriptor sets: objects, commands, counts, frame, depth pyramid and statistics
+	DSL.init(BP, {
+		{0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
+		{5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT}
+	});
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = static_cast<uint32_t>(4 * images);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[1].descriptorCount = static_cast<uint32_t>(images);
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = static_cast<uint32_t>(images);
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = static_cast<uint32_t>(images);
+	VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create culling descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(images, DSL.descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(images);
+	allocInfo.pSetLayouts = layouts.data();
+	descriptorSets.resize(images);
+	result = vkAllocateDescriptorSets(BP->device, &allocInfo, descriptorSets.data());
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to allocate culling descriptor sets!");
+	}
+	for (size_t i = 0; i < images; i++) {
+		VkBuffer buffers[] = {objectBuffers[i], commandBuffers[i], countBuffers[i],
+							  frameBuffers[i], VK_NULL_HANDLE, statisticsBuffers[i]};
+		VkDescriptorBufferInfo bufferInfos[6]{};
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = pyramid->sampler;
+		pyramidInfo.imageView = pyramid->view;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		std::array<VkWriteDescriptorSet, 6> descriptorWrites{};
+		for (uint32_t b = 0; b < 6; b++) {
+			descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[b].dstSet = descriptorSets[i];
+			descriptorWrites[b].dstBinding = b;
+			descriptorWrites[b].dstArrayElement = 0;
+			descriptorWrites[b].descriptorCount = 1;
+			if (b == 4) {
+				descriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				descriptorWrites[b].pImageInfo = &pyramidInfo;
+				continue;
+			}
+			bufferInfos[b].buffer = buffers[b];
+			bufferInfos[b].offset = 0;
+			bufferInfos[b].range = VK_WHOLE_SIZE;
+			descriptorWrites[b].descriptorType = b == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER :
+												 VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+		}
+		vkUpdateDescriptorSets(BP->device, static_cast<uint32_t>(descriptorWrites.size()),
+							   descriptorWrites.data(), 0, nullptr);
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DSL.descriptorSetLayout;
+	result = vkCreatePipelineLayout(BP->device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+	pipeline = BP->createComputePipeline(shader, pipelineLayout);
+}
+
+CullObject GpuCulling::object(const GeometryRange &range, const BoundingVolume &worldBounds,
+							  uint32_t instances, uint32_t firstInstance, uint32_t list) {
+	CullObject object{};
+	object.sphere = glm::vec4(worldBounds.center, worldBounds.radius);
+	object.boxMin = glm::vec4(worldBounds.min, 0);
+	object.boxMax = glm::vec4(worldBounds.max, 0);
+	object.indexCount = range.indexCount;
+	object.firstIndex = range.firstIndex;
+	object.vertexOffset = range.vertexOffset;
+	object.firstInstance = firstInstance;
+	object.instanceCount = instances;
+	object.list = list;
+	return object;
+}
+
+void GpuCulling::setObject(int currentImage, uint32_t index, CullObject object) {
+	if (index >= objectCapacity || object.list >= listCapacities.size()) {
+		throw std::runtime_error("culling object out of range!");
+	}
+	object.listStart = listStarts[object.list];
+	object.listCapacity = listCapacities[object.list];
+	objects[currentImage][index] = object;
+}
+
+// has to be recorded outside the render pass, before the draws of the lists
+void GpuCulling::record(VkCommandBuffer commandBuffer, int currentImage,
+						const std::array<glm::vec4, 6> &planes, glm::vec3 eye, float maxDistance) {
+	// the fence of the image was waited: its counters hold the last frame drawn with it
+	statistics = *counters[currentImage];
+
+	CullFrame &frame = *frames[currentImage];
+	for (int p = 0; p < 6; p++) {
+		frame.planes[p] = planes[p];
+	}
+	frame.eye = glm::vec4(eye, maxDistance);
+	frame.pyramidViewProjection = pyramid->viewProjection;
+	frame.pyramidSize = glm::vec2(pyramid->width, pyramid->height);
+	frame.objectCount = objectCapacity;
+	frame.occlusion = pyramid->valid ? 1 : 0;
+
+	vkCmdFillBuffer(commandBuffer, countBuffers[currentImage], 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(commandBuffer, statisticsBuffers[currentImage], 0, VK_WHOLE_SIZE, 0);
+
+	std::array<VkBufferMemoryBarrier, 2> cleared{};
+	VkBuffer counted[] = {countBuffers[currentImage], statisticsBuffers[currentImage]};
+	for (int b = 0; b < 2; b++) {
+		cleared[b].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		cleared[b].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		cleared[b].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		cleared[b].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		cleared[b].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		cleared[b].buffer = counted[b];
+		cleared[b].offset = 0;
+		cleared[b].size = VK_WHOLE_SIZE;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+						 0, nullptr, static_cast<uint32_t>(cleared.size()), cleared.data(), 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+							&descriptorSets[currentImage], 0, nullptr);
+	vkCmdDispatch(commandBuffer, (objectCapacity + CullFrame::groupSize - 1) / CullFrame::groupSize, 1, 1);
+
+	std::array<VkBufferMemoryBarrier, 3> written{};
+	VkBuffer outputs[] = {commandBuffers[currentImage], countBuffers[currentImage],
+						  statisticsBuffers[currentImage]};
+	for (int b = 0; b < 3; b++) {
+		written[b].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		written[b].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		written[b].dstAccessMask = b < 2 ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : VK_ACCESS_HOST_READ_BIT;
+		written[b].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		written[b].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		written[b].buffer = outputs[b];
+		written[b].offset = 0;
+		written[b].size = VK_WHOLE_SIZE;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+						 0, nullptr, static_cast<uint32_t>(written.size()), written.data(), 0, nullptr);
+}
+
+void GpuCulling::draw(VkCommandBuffer commandBuffer, int currentImage, uint32_t list) {
+	BP->cmdDrawIndexedIndirectCount(commandBuffer, commandBuffers[currentImage],
+			sizeof(VkDrawIndexedIndirectCommand) * listStarts[list],
+			countBuffers[currentImage], sizeof(uint32_t) * list,
+			listCapacities[list], sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void GpuCulling::cleanup() {
+	vkDestroyPipeline(BP->device, pipeline, nullptr);
+	vkDestroyPipelineLayout(BP->device, pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+	DSL.cleanup();
+	for (size_t i = 0; i < objectBuffers.size(); i++) {
+		vkUnmapMemory(BP->device, objectBuffersMemory[i]);
+		vkDestroyBuffer(BP->device, objectBuffers[i], nullptr);
+		vkFreeMemory(BP->device, objectBuffersMemory[i], nullptr);
+		vkDestroyBuffer(BP->device, commandBuffers[i], nullptr);
+		vkFreeMemory(BP->device, commandBuffersMemory[i], nullptr);
+		vkDestroyBuffer(BP->device, countBuffers[i], nullptr);
+		vkFreeMemory(BP->device, countBuffersMemory[i], nullptr);
+		vkUnmapMemory(BP->device, frameBuffersMemory[i]);
+		vkDestroyBuffer(BP->device, frameBuffers[i], nullptr);
+		vkFreeMemory(BP->device, frameBuffersMemory[i], nullptr);
+		vkUnmapMemory(BP->device, statisticsBuffersMemory[i]);
+		vkDestroyBuffer(BP->device, statisticsBuffers[i], nullptr);
+		vkFreeMemory(BP->device, statisticsBuffersMemory[i], nullptr);
+	}
+	objectBuffers.clear(); objectBuffersMemory.clear(); objects.clear();
+	commandBuffers.clear(); commandBuffersMemory.clear();
+	countBuffers.clear(); countBuffersMemory.clear();
+	frameBuffers.clear(); frameBuffersMemory.clear(); frames.clear();
+	statisticsBuffers.clear(); statisticsBuffersMemory.clear(); counters.clear();
 }
@@ -0,0 +1,37 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_TASKLOG_HPP
+#define DRONE_DELIVERY_TASKLOG_HPP
+
+#include <iostream>
+
+/**
+ * Keeps the messages of the code running on a thread while it is alive, so that tasks running at the same time don't
+ * mix their lines on std::cout: the thread waiting for the tasks prints what each of them kept, one after the other.
+ * Code that can run in such a task writes to TaskLog::stream() instead of std::cout, which is std::cout on the
+ * threads not keeping their messages.
+ */
+class TaskLog {
+    inline static thread_local std::ostream* current = &std::cout;
+    std::ostream* previous;
+
+public:
+    explicit TaskLog(std::ostream& messages) : previous(current) {
+        current = &messages;
+    }
+
+    ~TaskLog() {
+        current = previous;
+    }
+
+    TaskLog(const TaskLog&) = delete;
+    TaskLog& operator=(const TaskLog&) = delete;
+
+    static std::ostream& stream() {
+        return *current;
+    }
+};
+
+#endif //DRONE_DELIVERY_TASKLOG_HPP
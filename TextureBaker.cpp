@@ -0,0 +1,101 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+// Bakes PNG/JPG textures offline into KTX2 files with BC1 (opaque) or BC3 (with alpha) blocks and all their mip levels,
+// so that the game uploads them as they are instead of decoding them and generating the levels at startup.
+// Several images are packed in an atlas, with the region of each written in the key "atlasRegions" of the file, one
+// line per image: name u v width height. The hash of the images goes in the key "sourceHash", so that the game can tell
+// when a baked texture is older than its images. Doesn't need Vulkan.
+// usage: texture-baker output.ktx2 image [image...]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+#include "TextureBaking.hpp"
+#include "KTX2.hpp"
+
+RGBAImage loadImage(const std::string& file) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(file.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load image " + file);
+    }
+    RGBAImage image(width, height);
+    memcpy(image.pixels.data(), pixels, image.pixels.size());
+    stbi_image_free(pixels);
+    return image;
+}
+
+/**
+ * @return the file name without its folders: the game finds the regions by name wherever the images are
+ */
+std::string baseName(const std::string& file) {
+    size_t slash = file.find_last_of("/\\");
+    return slash == std::string::npos ? file : file.substr(slash + 1);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "usage: texture-baker output.ktx2 image [image...]\n";
+        return 1;
+    }
+    try {
+        auto start = std::chrono::steady_clock::now();
+        std::string output = argv[1];
+        std::vector<std::string> files(argv + 2, argv + argc);
+        std::vector<RGBAImage> images;
+        bool opaque = true;
+        for (const auto& file : files) {
+            images.push_back(loadImage(file));
+            opaque = opaque && images.back().isOpaque();
+        }
+
+        KTX2Texture texture;
+        RGBAImage base;
+        uint32_t maxLevels = 32;
+        if (images.size() == 1) {
+            base = std::move(images[0]);
+        } else {
+            std::vector<glm::vec4> regions;
+            base = AtlasPacking::pack(images, regions);
+            maxLevels = AtlasPacking::BLOCK_COMPRESSED_MIP_LEVELS;
+            std::ostringstream lines;
+            for (size_t i = 0; i < files.size(); i++) {
+                lines << baseName(files[i]) << " " << regions[i].x << " " << regions[i].y << " "
+                      << regions[i].z << " " << regions[i].w << "\n";
+            }
+            texture.keyValues.emplace_back("atlasRegions", lines.str());
+        }
+        texture.keyValues.emplace_back(KTX2Texture::SOURCE_HASH_KEY, KTX2Texture::hashFiles(files));
+
+        // the space between the cells of an atlas is never sampled: only the images decide if alpha is needed
+        texture.vkFormat = opaque ? KTX2Texture::FORMAT_BC1_RGB_SRGB : KTX2Texture::FORMAT_BC3_SRGB;
+        texture.width = static_cast<uint32_t>(base.width);
+        texture.height = static_cast<uint32_t>(base.height);
+        size_t decodedBytes = 0;
+        for (const auto& level : buildMipChain(base, maxLevels)) {
+            decodedBytes += level.pixels.size();
+            texture.levels.push_back(opaque ? BlockCompression::compressBC1(level) : BlockCompression::compressBC3(level));
+        }
+        texture.write(output);
+
+        size_t compressedBytes = 0;
+        for (const auto& level : texture.levels) compressedBytes += level.size();
+        auto end = std::chrono::steady_clock::now();
+        std::cout << output << ": " << base.width << "x" << base.height << ", " << texture.levels.size() << " levels, "
+                  << (opaque ? "BC1" : "BC3") << ", " << compressedBytes / 1024 << " KiB instead of "
+                  << decodedBytes / 1024 << " KiB of RGBA8 in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_TEXTUREBAKING_HPP
+#define DRONE_DELIVERY_TEXTUREBAKING_HPP
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <glm/glm.hpp>
+
+/**
+ * Work on the pixels of the textures that doesn't need a GPU: packing images in an atlas, mip levels and block
+ * compression. The game uses it to pack the atlases it has no baked file for, texture-baker to bake them offline.
+ */
+
+/**
+ * 8 bit sRGB pixels with alpha, rows from the top
+ */
+struct RGBAImage {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+
+    RGBAImage() = default;
+    RGBAImage(int width, int height) : width(width), height(height), pixels(static_cast<size_t>(width) * height * 4, 0) {}
+
+    unsigned char* at(int x, int y) {
+        return &pixels[(static_cast<size_t>(y) * width + x) * 4];
+    }
+
+    const unsigned char* at(int x, int y) const {
+        return &pixels[(static_cast<size_t>(y) * width + x) * 4];
+    }
+
+    /**
+     * @return true if the alpha of every pixel is 255: BC1 is enough, BC3 otherwise
+     */
+    bool isOpaque() const {
+        for (size_t i = 3; i < pixels.size(); i += 4) {
+            if (pixels[i] != 255) return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * Images placed on shelves, the tallest first, in an atlas about as wide as it is high. Every image takes a cell of its
+ * size rounded up to BORDER, plus BORDER on each side, repeating the edge of the image: cells start at multiples of
+ * BORDER, so with at most MIP_LEVELS levels no texel of any level covers two images. Block compressed levels can only
+ * go down to BLOCK_COMPRESSED_MIP_LEVELS: past that a 4x4 block would mix two images.
+ */
+struct AtlasPacking {
+    constexpr static const int BORDER = 16;
+    constexpr static const uint32_t MIP_LEVELS = 5; // log2(BORDER) + 1
+    constexpr static const uint32_t BLOCK_COMPRESSED_MIP_LEVELS = 3; // log2(BORDER / 4) + 1
+
+    /**
+     * @param regions filled with the region of each image in uv coordinates: offset in xy, size in zw
+     * @return the atlas; the space left at the end of the shelves is transparent black
+     */
+    static RGBAImage pack(const std::vector<RGBAImage>& images, std::vector<glm::vec4>& regions) {
+        auto cellSize = [](int size) { return (size + BORDER - 1) / BORDER * BORDER + 2 * BORDER; };
+
+        double cellsArea = 0;
+        int atlasWidth = 0;
+        for (const auto& image : images) {
+            cellsArea += static_cast<double>(cellSize(image.width)) * cellSize(image.height);
+            atlasWidth = std::max(atlasWidth, cellSize(image.width));
+        }
+        // some room for the space left at the end of the shelves
+        atlasWidth = std::max(atlasWidth, static_cast<int>(std::ceil(std::sqrt(cellsArea * 1.1) / BORDER)) * BORDER);
+
+        std::vector<size_t> order(images.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+            return images[a].height > images[b].height;
+        });
+        std::vector<glm::ivec2> cells(images.size());
+        int x = 0, y = 0, shelfHeight = 0;
+        for (size_t i : order) {
+            if (x + cellSize(images[i].width) > atlasWidth) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            cells[i] = {x, y};
+            x += cellSize(images[i].width);
+            shelfHeight = std::max(shelfHeight, cellSize(images[i].height));
+        }
+
+        RGBAImage atlas(atlasWidth, y + shelfHeight);
+        regions.resize(images.size());
+        for (size_t i = 0; i < images.size(); i++) {
+            const RGBAImage& image = images[i];
+            // every texel of the cell takes the nearest texel of the image
+            for (int cy = 0; cy < cellSize(image.height); cy++) {
+                int sy = std::min(std::max(cy - BORDER, 0), image.height - 1);
+                for (int cx = 0; cx < cellSize(image.width); cx++) {
+                    int sx = std::min(std::max(cx - BORDER, 0), image.width - 1);
+                    memcpy(atlas.at(cells[i].x + cx, cells[i].y + cy), image.at(sx, sy), 4);
+                }
+            }
+            regions[i] = glm::vec4(static_cast<float>(cells[i].x + BORDER) / atlas.width,
+                                   static_cast<float>(cells[i].y + BORDER) / atlas.height,
+                                   static_cast<float>(image.width) / atlas.width,
+                                   static_cast<float>(image.height) / atlas.height);
+        }
+        return atlas;
+    }
+};
+
+/**
+ * @return the image followed by its mip levels, each half the size of the one before, down to 1x1 or maxLevels.
+ * Texels are averaged in linear space, as the GPU blits of sRGB images do
+ */
+inline std::vector<RGBAImage> buildMipChain(const RGBAImage& image, uint32_t maxLevels) {
+    std::array<float, 256> toLinear{};
+    for (int i = 0; i < 256; i++) {
+        float c = static_cast<float>(i) / 255.0f;
+        toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    auto toSRGB = [](float c) {
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f));
+    };
+
+    std::vector<RGBAImage> levels = {image};
+    while (levels.size() < maxLevels && (levels.back().width > 1 || levels.back().height > 1)) {
+        const RGBAImage& source = levels.back();
+        RGBAImage level(std::max(source.width / 2, 1), std::max(source.height / 2, 1));
+        for (int y = 0; y < level.height; y++) {
+            for (int x = 0; x < level.width; x++) {
+                int x0 = std::min(2 * x, source.width - 1), x1 = std::min(2 * x + 1, source.width - 1);
+                int y0 = std::min(2 * y, source.height - 1), y1 = std::min(2 * y + 1, source.height - 1);
+                const unsigned char* texels[4] = {source.at(x0, y0), source.at(x1, y0),
+                                                  source.at(x0, y1), source.at(x1, y1)};
+                unsigned char* out = level.at(x, y);
+                for (int c = 0; c < 3; c++) {
+                    float sum = 0;
+                    for (auto texel : texels) sum += toLinear[texel[c]];
+                    out[c] = toSRGB(sum * 0.25f);
+                }
+                out[3] = static_cast<unsigned char>((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+/**
+ * BC1 and BC3 encoders: the colors of a 4x4 block are fit on their principal axis, the alpha of BC3 between its
+ * minimum and maximum. Blocks past the edge of the image repeat its last row and column
+ */
+class BlockCompression {
+private:
+    static uint16_t to565(const glm::vec3& color) {
+        glm::vec3 c = glm::clamp(color, 0.0f, 255.0f);
+        return static_cast<uint16_t>((static_cast<int>(std::lround(c.r * 31.0f / 255.0f)) << 11) |
+                                     (static_cast<int>(std::lround(c.g * 63.0f / 255.0f)) << 5) |
+                                     static_cast<int>(std::lround(c.b * 31.0f / 255.0f)));
+    }
+
+    static glm::vec3 from565(uint16_t color) {
+        return {static_cast<float>((color >> 11) & 31) * 255.0f / 31.0f,
+                static_cast<float>((color >> 5) & 63) * 255.0f / 63.0f,
+                static_cast<float>(color & 31) * 255.0f / 31.0f};
+    }
+
+    static void writeColorBlock(const std::array<glm::vec4, 16>& texels, unsigned char* out) {
+        glm::vec3 mean(0);
+        for (const auto& texel : texels) mean += glm::vec3(texel);
+        mean /= 16.0f;
+        glm::mat3 covariance(0);
+        for (const auto& texel : texels) {
+            glm::vec3 d = glm::vec3(texel) - mean;
+            covariance += glm::outerProduct(d, d);
+        }
+        glm::vec3 axis(1, 1, 1);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 next = covariance * axis;
+            float length = glm::length(next);
+            if (length < 1e-6f) break;
+            axis = next / length;
+        }
+        axis = glm::normalize(axis);
+        float minT = 0, maxT = 0;
+        for (const auto& texel : texels) {
+            float t = glm::dot(glm::vec3(texel) - mean, axis);
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float inset = (maxT - minT) / 16.0f; // the extremes are rarely worth a whole palette entry
+        uint16_t color0 = to565(mean + axis * (maxT - inset));
+        uint16_t color1 = to565(mean + axis * (minT + inset));
+        if (color0 < color1) std::swap(color0, color1); // 4 colors mode
+
+        glm::vec3 c0 = from565(color0), c1 = from565(color1);
+        std::array<glm::vec3, 4> palette = {c0, c1, (2.0f * c0 + c1) / 3.0f, (c0 + 2.0f * c1) / 3.0f};
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            for (int i = 0; i < 16; i++) {
+                uint32_t best = 0;
+                float bestDistance = std::numeric_limits<float>::max();
+                for (uint32_t p = 0; p < 4; p++) {
+                    glm::vec3 d = glm::vec3(texels[i]) - palette[p];
+                    float distance = glm::dot(d, d);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+        out[0] = static_cast<unsigned char>(color0 & 0xFF);
+        out[1] = static_cast<unsigned char>(color0 >> 8);
+        out[2] = static_cast<unsigned char>(color1 & 0xFF);
+        out[3] = static_cast<unsigned char>(color1 >> 8);
+        for (int i = 0; i < 4; i++) out[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+    }
+
+    static void writeAlphaBlock(const std::array<glm::vec4, 16>& texels, unsigned char* out) {
+        float minAlpha = 255, maxAlpha = 0;
+        for (const auto& texel : texels) {
+            minAlpha = std::min(minAlpha, texel.a);
+            maxAlpha = std::max(maxAlpha, texel.a);
+        }
+        auto alpha0 = static_cast<unsigned char>(maxAlpha), alpha1 = static_cast<unsigned char>(minAlpha);
+        std::array<float, 8> palette = {static_cast<float>(alpha0), static_cast<float>(alpha1)};
+        for (int p = 2; p < 8; p++) {
+            palette[p] = (static_cast<float>(8 - p) * alpha0 + static_cast<float>(p - 1) * alpha1) / 7.0f;
+        }
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            for (int i = 0; i < 16; i++) {
+                uint64_t best = 0;
+                for (uint64_t p = 1; p < 8; p++) {
+                    if (std::abs(texels[i].a - palette[p]) < std::abs(texels[i].a - palette[best])) best = p;
+                }
+                indices |= best << (3 * i);
+            }
+        }
+        out[0] = alpha0;
+        out[1] = alpha1;
+        for (int i = 0; i < 6; i++) out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+    }
+
+    static std::vector<unsigned char> compress(const RGBAImage& image, bool withAlpha) {
+        int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+        size_t blockBytes = withAlpha ? 16 : 8;
+        std::vector<unsigned char> blocks(static_cast<size_t>(blocksX) * blocksY * blockBytes);
+        std::array<glm::vec4, 16> texels;
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                for (int i = 0; i < 16; i++) {
+                    const unsigned char* texel = image.at(std::min(bx * 4 + i % 4, image.width - 1),
+                                                          std::min(by * 4 + i / 4, image.height - 1));
+                    texels[i] = glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+                }
+                unsigned char* out = &blocks[(static_cast<size_t>(by) * blocksX + bx) * blockBytes];
+                if (withAlpha) {
+                    writeAlphaBlock(texels, out);
+                    writeColorBlock(texels, out + 8);
+                } else {
+                    writeColorBlock(texels, out);
+                }
+            }
+        }
+        return blocks;
+    }
+
+public:
+    static std::vector<unsigned char> compressBC1(const RGBAImage& image) {
+        return compress(image, false);
+    }
+
+    static std::vector<unsigned char> compressBC3(const RGBAImage& image) {
+        return compress(image, true);
+    }
+};
+
+#endif //DRONE_DELIVERY_TEXTUREBAKING_HPP
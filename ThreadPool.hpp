@@ -0,0 +1,84 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_THREADPOOL_HPP
+#define DRONE_DELIVERY_THREADPOOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running the submitted tasks in order of submission. Destroying the pool waits for
+ * the tasks already submitted.
+ */
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    /**
+     * @param threads workers, 0 to use all the cores
+     */
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        workers.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::work, this);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @return future of the task: get() waits for it and rethrows what it threw
+     */
+    std::future<void> submit(std::function<void()> task) {
+        // std::function needs a copyable callable: the packaged task is shared with the queue
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> done = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        available.notify_one();
+        return done;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+#endif //DRONE_DELIVERY_THREADPOOL_HPP
@@ -0,0 +1,493 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_TRIANGLEBVH_HPP
+#define DRONE_DELIVERY_TRIANGLEBVH_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <utility>
+#include <glm/glm.hpp>
+#include "Obstacles.hpp"
+
+/**
+ * Bounding volume hierarchy over the triangles of the obstacle meshes.
+ * Built top-down with binned SAH splits, then flattened: the two children of a node are always stored next to each
+ * other, and the triangles are reordered so that every leaf owns a contiguous range of them.
+ * Unlike the vertex based obstacles it works on the actual faces, so a hit in the middle of a big face is detected.
+ */
+class TriangleBVH : public Obstacles {
+    // 32 bytes: two nodes per cache line
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t leftFirst; // leaf: index of the first triangle, inner node: index of the left child (right is next)
+        glm::vec3 boundsMax;
+        uint32_t count;     // number of triangles, 0 for inner nodes
+    };
+
+    struct Bounds {
+        glm::vec3 min{std::numeric_limits<float>::max()};
+        glm::vec3 max{- std::numeric_limits<float>::max()};
+
+        void grow(const glm::vec3& p) {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        void grow(const Bounds& b) {
+            min = glm::min(min, b.min);
+            max = glm::max(max, b.max);
+        }
+
+        float area() const {
+            glm::vec3 e = max - min;
+            return e.x < 0 ? 0 : e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+    };
+
+    constexpr static const int SAH_BINS = 16;
+    constexpr static const uint32_t MAX_LEAF_SIZE = 4;
+    constexpr static const float TRAVERSAL_COST = 1.0f; // relative to the cost of a triangle test
+    constexpr static const int STACK_SIZE = 64;
+    // each level of a traversal leaves at most one node on the stack, so the depth is bounded by its size
+    constexpr static const int MAX_DEPTH = STACK_SIZE - 2;
+
+    std::vector<Triangle> triangles;
+    std::vector<Node> nodes;
+
+    // build-time data
+    std::vector<Bounds> triangleBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> order;
+
+    void updateBounds(Node& node) {
+        Bounds b;
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) b.grow(triangleBounds[order[i]]);
+        node.boundsMin = b.min;
+        node.boundsMax = b.max;
+    }
+
+    /**
+     * looks for the cheapest split plane among the bin boundaries on all the axes
+     * @return SAH cost of the best split, or infinity if the centroids can't be separated
+     */
+    float findBestSplit(const Node& node, int& bestAxis, float& bestPosition) const {
+        Bounds centroidBounds;
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) centroidBounds.grow(centroids[order[i]]);
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        for (int axis = 0; axis < 3; ++axis) {
+            float lo = centroidBounds.min[axis];
+            float hi = centroidBounds.max[axis];
+            if (lo == hi) continue;
+
+            Bounds binBounds[SAH_BINS];
+            uint32_t binCount[SAH_BINS] = {};
+            float scale = SAH_BINS / (hi - lo);
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                uint32_t t = order[i];
+                int bin = std::min(SAH_BINS - 1, static_cast<int>((centroids[t][axis] - lo) * scale));
+                binCount[bin]++;
+                binBounds[bin].grow(triangleBounds[t]);
+            }
+
+            // sweep from both sides to get the cost of every split between two bins
+            float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+            uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+            Bounds left, right;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < SAH_BINS - 1; ++i) {
+                leftSum += binCount[i];
+                left.grow(binBounds[i]);
+                leftCount[i] = leftSum;
+                leftArea[i] = left.area();
+                rightSum += binCount[SAH_BINS - 1 - i];
+                right.grow(binBounds[SAH_BINS - 1 - i]);
+                rightCount[SAH_BINS - 2 - i] = rightSum;
+                rightArea[SAH_BINS - 2 - i] = right.area();
+            }
+            for (int i = 0; i < SAH_BINS - 1; ++i) {
+                if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPosition = lo + (i + 1) / scale;
+                }
+            }
+        }
+        return bestCost;
+    }
+
+    void subdivide(uint32_t nodeIndex, int depth) {
+        Node& node = nodes[nodeIndex];
+        if (node.count <= 1 || depth >= MAX_DEPTH) return;
+
+        int axis = 0;
+        float position = 0;
+        float splitCost = findBestSplit(node, axis, position);
+        Bounds nodeBounds{node.boundsMin, node.boundsMax};
+        float leafCost = node.count * nodeBounds.area();
+        // costs are compared without dividing by the parent area, so the traversal cost has to be scaled by it
+        if (node.count <= MAX_LEAF_SIZE && splitCost + TRAVERSAL_COST * nodeBounds.area() >= leafCost) return;
+        if (splitCost == std::numeric_limits<float>::infinity()) return; // all centroids coincide: can't split
+
+        auto first = order.begin() + node.leftFirst;
+        auto middle = std::partition(first, first + node.count,
+                                     [&](uint32_t t) { return centroids[t][axis] < position; });
+        uint32_t leftCount = static_cast<uint32_t>(middle - first);
+        if (leftCount == 0 || leftCount == node.count) return;
+
+        uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+        uint32_t firstTriangle = node.leftFirst;
+        uint32_t count = node.count;
+        nodes.push_back({{}, firstTriangle, {}, leftCount});
+        nodes.push_back({{}, firstTriangle + leftCount, {}, count - leftCount});
+        // push_back may have moved the array: don't use node from here on
+        nodes[nodeIndex].leftFirst = leftChild;
+        nodes[nodeIndex].count = 0;
+        updateBounds(nodes[leftChild]);
+        updateBounds(nodes[leftChild + 1]);
+        subdivide(leftChild, depth + 1);
+        subdivide(leftChild + 1, depth + 1);
+    }
+
+    static float distanceSquaredToBox(const glm::vec3& p, const Node& node) {
+        glm::vec3 d = glm::max(glm::max(node.boundsMin - p, p - node.boundsMax), glm::vec3(0));
+        return glm::dot(d, d);
+    }
+
+    /**
+     * closest point to p on a triangle (Ericson, Real-Time Collision Detection, 5.1.5)
+     */
+    static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const Triangle& t) {
+        glm::vec3 ab = t.v1 - t.v0, ac = t.v2 - t.v0, ap = p - t.v0;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0 && d2 <= 0) return t.v0;
+
+        glm::vec3 bp = p - t.v1;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0 && d4 <= d3) return t.v1;
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0) return t.v0 + ab * (d1 / (d1 - d3));
+
+        glm::vec3 cp = p - t.v2;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0 && d5 <= d6) return t.v2;
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0) return t.v0 + ac * (d2 / (d2 - d6));
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+            return t.v1 + (t.v2 - t.v1) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        return t.v0 + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    /**
+     * tells if the edge a->b of a counterclockwise (in xz) triangle owns the points lying exactly on it, so that a
+     * vertical ray through a shared edge is counted by only one of the two triangles
+     */
+    static bool ownsEdge(glm::vec2 a, glm::vec2 b) {
+        glm::vec2 d = b - a;
+        return d.y > 0 || (d.y == 0 && d.x < 0);
+    }
+
+    /**
+     * @return true if the vertical ray going up from p crosses the triangle
+     */
+    static bool rayUpCrosses(const glm::vec3& p, const Triangle& t) {
+        glm::vec2 a{t.v0.x, t.v0.z}, b{t.v1.x, t.v1.z}, c{t.v2.x, t.v2.z};
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0) return false; // vertical faces (walls) can't be crossed by a vertical ray
+        if (area < 0) std::swap(b, c);
+        glm::vec2 q{p.x, p.z};
+        auto edge = [&q](glm::vec2 from, glm::vec2 to) {
+            return (to.x - from.x) * (q.y - from.y) - (to.y - from.y) * (q.x - from.x);
+        };
+        float w0 = edge(b, c), w1 = edge(c, a), w2 = edge(a, b);
+        if (w0 < 0 || w1 < 0 || w2 < 0) return false;
+        if ((w0 == 0 && !ownsEdge(b, c)) || (w1 == 0 && !ownsEdge(c, a)) || (w2 == 0 && !ownsEdge(a, b))) return false;
+
+        // height of the triangle above q by barycentric interpolation (w0, w1, w2 weight a, b, c)
+        float hb = area < 0 ? t.v2.y : t.v1.y;
+        float hc = area < 0 ? t.v1.y : t.v2.y;
+        float height = (w0 * t.v0.y + w1 * hb + w2 * hc) / std::abs(area);
+        return height > p.y;
+    }
+
+    /**
+     * slab test of the segment origin + movement * t, t in [0, maxT] against a box
+     */
+    static bool segmentCrossesBox(const glm::vec3& origin, const glm::vec3& movement, const glm::vec3& boxMin,
+                                  const glm::vec3& boxMax, float maxT) {
+        float enter = 0, exit = maxT;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (movement[axis] == 0) {
+                if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis]) return false;
+                continue;
+            }
+            float inverse = 1.0f / movement[axis];
+            float t0 = (boxMin[axis] - origin[axis]) * inverse;
+            float t1 = (boxMax[axis] - origin[axis]) * inverse;
+            if (t0 > t1) std::swap(t0, t1);
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+            if (enter > exit) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @return first t >= 0 at which origin + movement * t is at distance radius from center, or NO_IMPACT
+     */
+    static float sweepPoint(const glm::vec3& origin, const glm::vec3& movement, const glm::vec3& center, float radius) {
+        glm::vec3 m = origin - center;
+        float a = glm::dot(movement, movement);
+        float b = glm::dot(m, movement);
+        float c = glm::dot(m, m) - radius * radius;
+        if (a == 0 || b > 0) return NO_IMPACT; // not moving or moving away
+        float discriminant = b * b - a * c;
+        if (discriminant < 0) return NO_IMPACT;
+        return std::max(0.0f, (- b - std::sqrt(discriminant)) / a);
+    }
+
+    /**
+     * ray against the side of the capsule around the edge p-q (Ericson, Real-Time Collision Detection, 5.3.7)
+     * @return first t >= 0 at which origin + movement * t is at distance radius from the inside of the edge, or NO_IMPACT
+     */
+    static float sweepEdge(const glm::vec3& origin, const glm::vec3& movement, const glm::vec3& p, const glm::vec3& q,
+                           float radius) {
+        glm::vec3 e = q - p, m = origin - p;
+        float ee = glm::dot(e, e), md = glm::dot(m, e), nd = glm::dot(movement, e);
+        float a = ee * glm::dot(movement, movement) - nd * nd;
+        if (ee == 0 || a <= 0) return NO_IMPACT; // parallel to the edge: the vertices catch it
+        float b = ee * glm::dot(m, movement) - nd * md;
+        float c = ee * (glm::dot(m, m) - radius * radius) - md * md;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0) return NO_IMPACT;
+        float t = (- b - std::sqrt(discriminant)) / a;
+        if (t < 0) return NO_IMPACT;
+        float s = (md + t * nd) / ee; // position of the contact along the edge
+        return s >= 0 && s <= 1 ? t : NO_IMPACT;
+    }
+
+    /**
+     * @return first t in [0, 1] at which the sphere moving along origin + movement * t touches the triangle, or NO_IMPACT
+     */
+    static float sweepTriangle(const glm::vec3& origin, const glm::vec3& movement, float radius, const Triangle& t) {
+        float best = NO_IMPACT;
+        glm::vec3 faceNormal = glm::cross(t.v1 - t.v0, t.v2 - t.v0);
+        if (glm::dot(faceNormal, faceNormal) > 0) {
+            glm::vec3 normal = glm::normalize(faceNormal);
+            float distance = glm::dot(origin - t.v0, normal);
+            if (distance < 0) {
+                normal = - normal;
+                distance = - distance;
+            }
+            float approach = - glm::dot(movement, normal);
+            if (approach > 0 && distance > radius) {
+                float time = (distance - radius) / approach;
+                glm::vec3 contact = origin + movement * time - normal * radius;
+                bool insideFace = glm::dot(glm::cross(t.v1 - t.v0, contact - t.v0), faceNormal) >= 0 &&
+                                  glm::dot(glm::cross(t.v2 - t.v1, contact - t.v1), faceNormal) >= 0 &&
+                                  glm::dot(glm::cross(t.v0 - t.v2, contact - t.v2), faceNormal) >= 0;
+                if (time <= 1 && insideFace) best = time;
+            }
+        }
+        if (best != NO_IMPACT) return best; // touching the face comes before touching its border
+        for (const auto& edge : {std::make_pair(t.v0, t.v1), std::make_pair(t.v1, t.v2), std::make_pair(t.v2, t.v0)}) {
+            best = std::min(best, sweepEdge(origin, movement, edge.first, edge.second, radius));
+        }
+        for (const auto& vertex : {t.v0, t.v1, t.v2}) {
+            best = std::min(best, sweepPoint(origin, movement, vertex, radius));
+        }
+        return best <= 1.0f ? best : NO_IMPACT;
+    }
+
+public:
+    /**
+     * adds the triangles of a mesh to the ones that will be indexed by the next build, see appendTriangles
+     */
+    template<class Vert>
+    void addMesh(const std::vector<Vert>& vertices, const std::vector<uint32_t>& indices, glm::vec3 translation) {
+        appendTriangles(triangles, vertices, indices, translation);
+    }
+
+    /**
+     * adds triangles already in world coordinates to the ones that will be indexed by the next build
+     */
+    void addTriangles(const std::vector<Triangle>& soup) {
+        triangles.insert(triangles.end(), soup.begin(), soup.end());
+    }
+
+    /**
+     * builds the hierarchy over all the triangles added so far
+     */
+    void build() {
+        nodes.clear();
+        if (triangles.empty()) return;
+
+        triangleBounds.resize(triangles.size());
+        centroids.resize(triangles.size());
+        order.resize(triangles.size());
+        for (uint32_t i = 0; i < triangles.size(); ++i) {
+            const Triangle& t = triangles[i];
+            triangleBounds[i] = Bounds();
+            triangleBounds[i].grow(t.v0);
+            triangleBounds[i].grow(t.v1);
+            triangleBounds[i].grow(t.v2);
+            centroids[i] = (t.v0 + t.v1 + t.v2) / 3.0f;
+            order[i] = i;
+        }
+
+        nodes.reserve(2 * triangles.size());
+        nodes.push_back({{}, 0, {}, static_cast<uint32_t>(triangles.size())});
+        updateBounds(nodes[0]);
+        subdivide(0, 0);
+
+        // store the triangles in leaf order, so that a leaf reads a contiguous block
+        std::vector<Triangle> sorted(triangles.size());
+        for (size_t i = 0; i < order.size(); ++i) sorted[i] = triangles[order[i]];
+        triangles.swap(sorted);
+
+        triangleBounds = std::vector<Bounds>();
+        centroids = std::vector<glm::vec3>();
+        order = std::vector<uint32_t>();
+    }
+
+    /**
+     * point in volume test by ray parity: counts the faces crossed by a vertical ray going up from the point.
+     * Works for the city buildings also without a floor face, since they are only open at the bottom
+     * @return true if the point is inside a mesh
+     */
+    bool pointInVolume(const glm::vec3& p) const {
+        if (nodes.empty()) return false;
+        bool inside = false;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (p.x < node.boundsMin.x || p.x > node.boundsMax.x ||
+                p.z < node.boundsMin.z || p.z > node.boundsMax.z || p.y > node.boundsMax.y) continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    if (rayUpCrosses(p, triangles[i])) inside = !inside;
+                }
+            } else {
+                stack[top++] = node.leftFirst;
+                stack[top++] = node.leftFirst + 1;
+            }
+        }
+        return inside;
+    }
+
+    /**
+     * @return true if any triangle is at distance lower or equal than radius from center
+     */
+    bool sphereOverlap(const glm::vec3& center, float radius) const {
+        if (nodes.empty()) return false;
+        float radiusSquared = radius * radius;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (distanceSquaredToBox(center, node) > radiusSquared) continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    glm::vec3 d = closestPointOnTriangle(center, triangles[i]) - center;
+                    if (glm::dot(d, d) <= radiusSquared) return true;
+                }
+            } else {
+                stack[top++] = node.leftFirst;
+                stack[top++] = node.leftFirst + 1;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * finds the point of the obstacle surfaces closest to p
+     * @param closest set to the closest point, untouched if there are no triangles
+     * @return distance between p and closest, infinity if there are no triangles
+     */
+    float closestPoint(const glm::vec3& p, glm::vec3& closest) const {
+        float bestSquared = std::numeric_limits<float>::infinity();
+        if (nodes.empty()) return bestSquared;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (distanceSquaredToBox(p, node) >= bestSquared) continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    glm::vec3 candidate = closestPointOnTriangle(p, triangles[i]);
+                    glm::vec3 d = candidate - p;
+                    if (glm::dot(d, d) < bestSquared) {
+                        bestSquared = glm::dot(d, d);
+                        closest = candidate;
+                    }
+                }
+            } else {
+                // the nearer child is pushed last so it is visited first and prunes more of the other one
+                uint32_t near = node.leftFirst, far = node.leftFirst + 1;
+                if (distanceSquaredToBox(p, nodes[far]) < distanceSquaredToBox(p, nodes[near])) std::swap(near, far);
+                stack[top++] = far;
+                stack[top++] = near;
+            }
+        }
+        return std::sqrt(bestSquared);
+    }
+
+    bool collidesWith(const glm::vec3& center, float radius) const override {
+        return sphereOverlap(center, radius) || pointInVolume(center);
+    }
+
+    /**
+     * exact swept sphere test: the first contact with a triangle is the earliest among the sphere reaching the face,
+     * one of the edges (ray against a capsule side) or one of the vertices (ray against a sphere).
+     * The traversal only visits the nodes whose box, grown by the radius, is crossed by the segment before the best
+     * time of impact found so far
+     */
+    float timeOfImpact(const glm::vec3& from, const glm::vec3& to, float radius) const override {
+        if (nodes.empty()) return NO_IMPACT;
+        if (collidesWith(from, radius)) return 0;
+
+        glm::vec3 movement = to - from;
+        float best = NO_IMPACT;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (!segmentCrossesBox(from, movement, node.boundsMin - glm::vec3(radius), node.boundsMax + glm::vec3(radius),
+                                   std::min(best, 1.0f))) continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    best = std::min(best, sweepTriangle(from, movement, radius, triangles[i]));
+                }
+            } else {
+                stack[top++] = node.leftFirst;
+                stack[top++] = node.leftFirst + 1;
+            }
+        }
+        return best <= 1.0f ? best : NO_IMPACT;
+    }
+
+    const std::vector<Triangle>& getTriangles() const {
+        return triangles;
+    }
+};
+
+#endif //DRONE_DELIVERY_TRIANGLEBVH_HPP
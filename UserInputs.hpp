@@ -22,10 +22,16 @@ struct UserInputs {
     GameState& gameState;
 
 public:
-    UserInputs(BaseProject* project, GameState& gameState):
+    /**
+     * builds the inputs of a frame from the raw values read from the keyboard and gamepad (or from a script)
+     * buttons are debounced across frames: build exactly one UserInputs per frame
+     */
+    UserInputs(float deltaT, glm::vec3 m, glm::vec3 r, bool fire, GameState& gameState):
+    deltaT(deltaT),
+    m(m),
+    r(r),
+    fire(fire),
     gameState(gameState) {
-        project->getSixAxis(deltaT, m, r, fire);
-
         // To debounce the pressing of the fire button, and start the event when the key is released
         static bool wasFire = false;
         handleFire = (wasFire && (!fire)) && gameState == PLAYING;
@@ -0,0 +1,179 @@
+//
+// Created by Carlo Ronconi on 16/10/26.
+//
+
+#ifndef DRONE_DELIVERY_VERTEXOBSTACLES_HPP
+#define DRONE_DELIVERY_VERTEXOBSTACLES_HPP
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <glm/glm.hpp>
+#include "Obstacles.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/**
+ * std::vector allocator returning memory aligned to Alignment bytes, so that SIMD loads can be aligned
+ */
+template<class T, size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<class U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template<class U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+    template<class U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+/**
+ * Brute force implementation: checks every vertex at each query. Kept as the correct fallback for the faster
+ * implementations, so it is made as fast as a linear scan can be: the vertices are stored as separate x, y, z arrays
+ * (32 byte aligned, padded to a multiple of 8) and tested 8 (AVX2) or 4 (SSE2) at a time with squared distances.
+ * Builds without SSE2 use the scalar loop, which gives the same results.
+ * The squared distances are compared with the threshold of sqrtThreshold instead of the squared radius, so also the
+ * points at the boundary of the cylinder are classified exactly as glm::length(d) < radius would (as long as the
+ * compiler doesn't contract dx * dx + dz * dz into a fused multiply add).
+ */
+class VertexObstacles : public HeightObstacles {
+public:
+    constexpr static const size_t ALIGNMENT = 32;
+    constexpr static const size_t LANES = 8; // arrays are padded for the widest kernel
+
+    using FloatArray = std::vector<float, AlignedAllocator<float, ALIGNMENT>>;
+
+private:
+    FloatArray xs, ys, zs;
+    size_t count = 0;
+
+    /**
+     * the square root is correctly rounded, so it is monotonic: sqrt(d2) < radius holds exactly for the d2 below the
+     * smallest float whose square root reaches the radius. radius * radius is within an ulp or two of it
+     */
+    static float sqrtThreshold(float radius) {
+        if (!(radius > 0)) return 0; // no distance is below it
+        float threshold = radius * radius;
+        while (threshold > 0 && std::sqrt(std::nextafter(threshold, 0.0f)) >= radius) {
+            threshold = std::nextafter(threshold, 0.0f);
+        }
+        while (std::sqrt(threshold) < radius) {
+            threshold = std::nextafter(threshold, std::numeric_limits<float>::infinity());
+        }
+        return threshold;
+    }
+
+    float scalarKernel(glm::vec2 center, float radiusSquared) const {
+        float highest = NO_OBSTACLE_HEIGHT;
+        for (size_t i = 0; i < count; ++i) {
+            float dx = xs[i] - center.x;
+            float dz = zs[i] - center.y;
+            if (dx * dx + dz * dz < radiusSquared && ys[i] > highest) highest = ys[i];
+        }
+        return highest;
+    }
+
+#if defined(__AVX2__)
+    float simdKernel(glm::vec2 center, float radiusSquared) const {
+        const __m256 cx = _mm256_set1_ps(center.x);
+        const __m256 cz = _mm256_set1_ps(center.y);
+        const __m256 r2 = _mm256_set1_ps(radiusSquared);
+        const __m256 none = _mm256_set1_ps(NO_OBSTACLE_HEIGHT);
+        __m256 highest = none;
+        for (size_t i = 0; i < xs.size(); i += 8) {
+            __m256 dx = _mm256_sub_ps(_mm256_load_ps(&xs[i]), cx);
+            __m256 dz = _mm256_sub_ps(_mm256_load_ps(&zs[i]), cz);
+            __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+            __m256 inside = _mm256_cmp_ps(d2, r2, _CMP_LT_OQ);
+            highest = _mm256_max_ps(highest, _mm256_blendv_ps(none, _mm256_load_ps(&ys[i]), inside));
+        }
+        // horizontal max: 8 -> 4 -> 2 -> 1
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(highest), _mm256_extractf128_ps(highest, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    float simdKernel(glm::vec2 center, float radiusSquared) const {
+        const __m128 cx = _mm_set1_ps(center.x);
+        const __m128 cz = _mm_set1_ps(center.y);
+        const __m128 r2 = _mm_set1_ps(radiusSquared);
+        const __m128 none = _mm_set1_ps(NO_OBSTACLE_HEIGHT);
+        __m128 highest = none;
+        for (size_t i = 0; i < xs.size(); i += 4) {
+            __m128 dx = _mm_sub_ps(_mm_load_ps(&xs[i]), cx);
+            __m128 dz = _mm_sub_ps(_mm_load_ps(&zs[i]), cz);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+            __m128 inside = _mm_cmplt_ps(d2, r2);
+            // no blend in SSE2: select y where inside, NO_OBSTACLE_HEIGHT elsewhere
+            __m128 candidate = _mm_or_ps(_mm_and_ps(inside, _mm_load_ps(&ys[i])), _mm_andnot_ps(inside, none));
+            highest = _mm_max_ps(highest, candidate);
+        }
+        // horizontal max: 4 -> 2 -> 1
+        highest = _mm_max_ps(highest, _mm_movehl_ps(highest, highest));
+        highest = _mm_max_ss(highest, _mm_shuffle_ps(highest, highest, 1));
+        return _mm_cvtss_f32(highest);
+    }
+#endif
+
+public:
+    explicit VertexObstacles(const std::vector<glm::vec3>& vertices) {
+        setVertices(vertices);
+    }
+
+    void setVertices(const std::vector<glm::vec3>& vertices) {
+        count = vertices.size();
+        size_t padded = (count + LANES - 1) / LANES * LANES;
+        // padding vertices are infinitely far: their squared distance never passes the radius test
+        xs.assign(padded, std::numeric_limits<float>::infinity());
+        ys.assign(padded, NO_OBSTACLE_HEIGHT);
+        zs.assign(padded, std::numeric_limits<float>::infinity());
+        for (size_t i = 0; i < count; ++i) {
+            xs[i] = vertices[i].x;
+            ys[i] = vertices[i].y;
+            zs[i] = vertices[i].z;
+        }
+    }
+
+    float highestPointWithin(glm::vec2 center, float radius) const override {
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+        return simdKernel(center, sqrtThreshold(radius));
+#else
+        return scalarKernel(center, sqrtThreshold(radius));
+#endif
+    }
+
+    /**
+     * same query without SIMD, to check and benchmark the vectorized kernel against
+     */
+    float scalarHighestPointWithin(glm::vec2 center, float radius) const {
+        return scalarKernel(center, sqrtThreshold(radius));
+    }
+};
+
+#endif //DRONE_DELIVERY_VERTEXOBSTACLES_HPP
@@ -21,7 +21,6 @@ layout(set = 1, binding = 0) uniform UniformBufferObject {
     mat4 mvpMat;
     mat4 mMat;
     mat4 nMat;
-    vec3 offset;
 } ubo;
 
 layout(set = 1, binding = 1) uniform sampler2D tex;
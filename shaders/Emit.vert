@@ -7,25 +7,23 @@ layout(set = 1, binding = 0) uniform UniformBufferObject {
 	mat4 mvpMat;
 	mat4 mMat;
 	mat4 nMat;
-	vec3 offset;
-	float dim;
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNorm;
 layout(location = 2) in vec2 inUV;
+// per instance: the transform of the instance, applied before mMat
+layout(location = 3) in mat4 inInstanceMat;
 
 layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec2 outUV;
 
 void main() {
-	//vec3 offset = ubo.offset * gl_InstanceIndex;
-	//gl_Position = ubo.mvpMat * vec4(inPosition + offset, 1.0);
+	vec4 position = inInstanceMat * vec4(inPosition, 1.0);
+	gl_Position = ubo.mvpMat * position;
 
-	gl_Position = ubo.mvpMat * vec4(inPosition + vec3(mod(gl_InstanceIndex,  ubo.dim) * ubo.offset.x, 0.0, (gl_InstanceIndex / int(ubo.dim)) * ubo.offset.z), 1.0);
-
-	fragPos = (ubo.mMat * vec4(inPosition, 1.0)).xyz;
-	fragNorm = (ubo.nMat * vec4(inNorm, 0.0)).xyz;
+	fragPos = (ubo.mMat * position).xyz;
+	fragNorm = (ubo.nMat * vec4(transpose(inverse(mat3(inInstanceMat))) * inNorm, 0.0)).xyz;
 	outUV = inUV;
 }
\ No newline at end of file
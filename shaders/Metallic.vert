@@ -1,13 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
-layout(set = 1, binding = 0) uniform UniformBufferObject {
-	float amb;
-	float gamma;
-	vec3 sColor;
+// transforms are pushed with each draw, the material stays in the uniform block read by the fragment shader
+layout(push_constant) uniform PushConstants {
 	mat4 mvpMat;
 	mat4 mMat;
-	mat4 nMat;
-} ubo;
+} push;
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNorm;
 layout(location = 2) in vec2 inUV;
@@ -16,8 +13,8 @@ layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec2 outUV;
 void main() {
-	gl_Position = ubo.mvpMat * vec4(inPosition, 1.0);
-	fragPos = (ubo.mMat * vec4(inPosition, 1.0)).xyz;
-	fragNorm = (ubo.nMat * vec4(inNorm, 0.0)).xyz;
+	gl_Position = push.mvpMat * vec4(inPosition, 1.0);
+	fragPos = (push.mMat * vec4(inPosition, 1.0)).xyz;
+	fragNorm = transpose(inverse(mat3(push.mMat))) * inNorm;
 	outUV = inUV;
 }
\ No newline at end of file
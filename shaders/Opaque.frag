@@ -18,9 +18,6 @@ layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
 layout(set = 1, binding = 0) uniform UniformBufferObject {
     float amb;
     float sigma;
-    mat4 mvpMat;
-    mat4 mMat;
-    mat4 nMat;
 } ubo;
 
 layout(set = 1, binding = 1) uniform sampler2D tex;
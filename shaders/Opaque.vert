@@ -1,13 +1,11 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 1, binding = 0) uniform UniformBufferObject {
-	float amb;
-	float sigma;
+// transforms are pushed with each draw, the material stays in the uniform block read by the fragment shader
+layout(push_constant) uniform PushConstants {
 	mat4 mvpMat;
 	mat4 mMat;
-	mat4 nMat;
-} ubo;
+} push;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNorm;
@@ -22,8 +20,8 @@ const vec3 distance = vec3(- 16.0f, 0.0f, 0.0f);
 void main() {
 	vec3 offset = distance * gl_InstanceIndex;
 
-	gl_Position = ubo.mvpMat * vec4(inPosition + offset, 1.0);
-	fragPos = (ubo.mMat * vec4(inPosition, 1.0)).xyz;
-	fragNorm = (ubo.nMat * vec4(inNorm, 0.0)).xyz;
+	gl_Position = push.mvpMat * vec4(inPosition + offset, 1.0);
+	fragPos = (push.mMat * vec4(inPosition, 1.0)).xyz;
+	fragNorm = transpose(inverse(mat3(push.mMat))) * inNorm;
 	outUV = inUV;
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// the city blocks are drawn together from one indirect buffer: the firstInstance of each draw is the index of the
+// block, so its transforms are found with gl_InstanceIndex. The material is the one of Opaque.frag
+struct ModelTransforms {
+	mat4 mvpMat;
+	mat4 mMat;
+};
+
+layout(set = 2, binding = 0) uniform CityUniformBufferObject {
+	ModelTransforms blocks[12];
+} city;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNorm;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec3 fragNorm;
+layout(location = 2) out vec2 outUV;
+
+void main() {
+	ModelTransforms block = city.blocks[gl_InstanceIndex];
+
+	gl_Position = block.mvpMat * vec4(inPosition, 1.0);
+	fragPos = (block.mMat * vec4(inPosition, 1.0)).xyz;
+	fragNorm = transpose(inverse(mat3(block.mMat))) * inNorm;
+	outUV = inUV;
+}
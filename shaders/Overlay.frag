@@ -1 +1 @@
-#version 450#extension GL_ARB_separate_shader_objects : enablelayout(location = 0) in vec2 fragUV;layout(location = 0) out vec4 outColor;layout(binding = 1) uniform sampler2D tex;void main() {	// change to also take transparency from texture (w) to allow transparent PNGs	outColor = texture(tex, fragUV).xyzw;	// output color}
\ No newline at end of file
+#version 450#extension GL_ARB_separate_shader_objects : enablelayout(location = 0) in vec2 fragUV;layout(location = 0) out vec4 outColor;layout(binding = 0) uniform sampler2D tex;void main() {	// change to also take transparency from texture (w) to allow transparent PNGs	outColor = texture(tex, fragUV).xyzw;	// output color}
\ No newline at end of file
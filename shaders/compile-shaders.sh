@@ -2,9 +2,13 @@ glslc Metallic.frag -o MetallicFrag.spv
 glslc Metallic.vert -o MetallicVert.spv
 glslc Opaque.frag -o OpaqueFrag.spv
 glslc Opaque.vert -o OpaqueVert.spv
+glslc OpaqueCity.vert -o OpaqueCityVert.spv
 glslc Overlay.frag -o OverlayFrag.spv
 glslc Overlay.vert -o OverlayVert.spv
 glslc Emit.frag -o EmitFrag.spv
 glslc Emit.vert -o EmitVert.spv
 glslc Animation.frag -o AnimationFrag.spv
-glslc Animation.vert -o AnimationVert.spv
\ No newline at end of file
+glslc Animation.vert -o AnimationVert.spv
+glslc Cull.comp -o CullComp.spv
+glslc HiZ.comp -o HiZComp.spv
+glslc -DMULTISAMPLED HiZ.comp -o HiZDepthComp.spv
\ No newline at end of file
@@ -0,0 +1,4 @@
+../texture-baker Textures_City.ktx2 Textures_City.png
+../texture-baker city_emit.ktx2 city_emit.png
+../texture-baker tube.ktx2 tube.png
+../texture-baker overlays.ktx2 BoxScore.jpg life.png splash.png win.png lose.png help.png
\ No newline at end of file